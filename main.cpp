@@ -0,0 +1,1890 @@
+#include "tomasulo.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <list>
+#include <future>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+class WorkStealingPool
+{
+private:
+    struct Worker
+    {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<Worker>> workers;
+
+    bool takeLocal(size_t self, function<void()> &task)
+    {
+        Worker &worker = *workers[self];
+        lock_guard<mutex> guard(worker.lock);
+        if (worker.tasks.empty())
+            return false;
+
+        task = move(worker.tasks.back());
+        worker.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t self, function<void()> &task)
+    {
+        for (size_t offset = 1; offset < workers.size(); offset++)
+        {
+            Worker &victim = *workers[(self + offset) % workers.size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (victim.tasks.empty())
+                continue;
+
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void work(size_t self)
+    {
+        function<void()> task;
+        while (takeLocal(self, task) || steal(self, task))
+            task();
+    }
+
+public:
+    explicit WorkStealingPool(size_t threadCount)
+    {
+        for (size_t i = 0; i < max<size_t>(1, threadCount); i++)
+            workers.push_back(make_unique<Worker>());
+    }
+
+    size_t size() const
+    {
+        return workers.size();
+    }
+
+    void run(vector<function<void()>> tasks)
+    {
+        for (size_t i = 0; i < tasks.size(); i++)
+            workers[i % workers.size()]->tasks.push_back(move(tasks[i]));
+
+        vector<thread> threads;
+        for (size_t i = 1; i < workers.size(); i++)
+            threads.emplace_back(&WorkStealingPool::work, this, i);
+
+        work(0);
+        for (thread &t : threads)
+            t.join();
+    }
+};
+
+struct SweepAxis
+{
+    const char *option;
+    const char *column;
+    int TomasuloConfig::*field;
+    vector<int> values;
+};
+
+struct SweepSpace
+{
+    TomasuloConfig base;
+    vector<SweepAxis> axes{
+        {"--add", "add_rs", &TomasuloConfig::addStations, {}},
+        {"--mul", "mul_rs", &TomasuloConfig::mulStations, {}},
+        {"--ls", "ls_rs", &TomasuloConfig::loadStoreStations, {}},
+        {"--rob", "rob", &TomasuloConfig::robSize, {}},
+        {"--lat-add", "lat_add", &TomasuloConfig::addSubLatency, {}},
+        {"--lat-mul", "lat_mul", &TomasuloConfig::mulLatency, {}},
+        {"--lat-div", "lat_div", &TomasuloConfig::divLatency, {}},
+        {"--lat-ls", "lat_ls", &TomasuloConfig::loadStoreLatency, {}},
+        {"--issue-width", "issue_width", &TomasuloConfig::issueWidth, {}},
+        {"--commit-width", "commit_width", &TomasuloConfig::commitWidth, {}},
+        {"--cdbs", "cdbs", &TomasuloConfig::cdbCount, {}},
+        {"--phys-regs", "phys_regs", &TomasuloConfig::physicalRegisters, {}}};
+
+    SweepAxis *findAxis(const string &option)
+    {
+        for (SweepAxis &axis : axes)
+        {
+            if (option == axis.option)
+                return &axis;
+        }
+        return nullptr;
+    }
+
+    vector<TomasuloConfig> expand() const
+    {
+        vector<TomasuloConfig> configs;
+        vector<size_t> position(axes.size(), 0);
+
+        while (true)
+        {
+            TomasuloConfig config = base;
+            for (size_t a = 0; a < axes.size(); a++)
+            {
+                if (!axes[a].values.empty())
+                    config.*axes[a].field = axes[a].values[position[a]];
+            }
+            configs.push_back(config);
+
+            size_t a = 0;
+            for (; a < axes.size(); a++)
+            {
+                if (++position[a] < max<size_t>(1, axes[a].values.size()))
+                    break;
+                position[a] = 0;
+            }
+            if (a == axes.size())
+                return configs;
+        }
+    }
+};
+
+bool parseSweepValues(const string &text, vector<int> &values)
+{
+    values.clear();
+
+    stringstream items(text);
+    string item;
+    while (getline(items, item, ','))
+    {
+        int first = 0, last = 0, step = 1;
+        char dash = 0, colon = 0;
+        istringstream iss(item);
+
+        if (!(iss >> first) || first < 0)
+            return false;
+
+        last = first;
+        if (iss >> dash)
+        {
+            if (dash != '-' || !(iss >> last) || last < first)
+                return false;
+            if (iss >> colon && (colon != ':' || !(iss >> step) || step < 1))
+                return false;
+        }
+
+        for (int value = first; value <= last; value += step)
+            values.push_back(value);
+    }
+
+    return !values.empty();
+}
+
+bool parseCacheLevel(const string &text, CacheLevelConfig &level)
+{
+    stringstream fields(text);
+    string field;
+    vector<string> values;
+    while (getline(fields, field, ','))
+        values.push_back(field);
+
+    if (values.size() != 4 && values.size() != 5)
+        return false;
+
+    level.sizeBytes = atoi(values[0].c_str());
+    level.associativity = atoi(values[1].c_str());
+    level.lineBytes = atoi(values[2].c_str());
+    level.hitLatency = atoi(values[3].c_str());
+    level.policy = ReplacementPolicy::LRU;
+
+    if (values.size() == 5)
+    {
+        if (values[4] == "fifo")
+            level.policy = ReplacementPolicy::FIFO;
+        else if (values[4] == "random")
+            level.policy = ReplacementPolicy::Random;
+        else if (values[4] != "lru")
+            return false;
+    }
+
+    return level.sizeBytes > 0 && level.associativity > 0 && level.lineBytes > 0 && level.hitLatency > 0;
+}
+
+bool parseFunctionalUnits(const string &text, FunctionalUnitConfig &units)
+{
+    stringstream fields(text);
+    string field;
+    vector<string> values;
+    while (getline(fields, field, ','))
+        values.push_back(field);
+
+    if (values.empty() || values.size() > 2)
+        return false;
+
+    units.count = atoi(values[0].c_str());
+    units.interval = 1;
+    units.pipelined = true;
+
+    if (values.size() == 2)
+    {
+        if (values[1] == "unpipelined")
+            units.pipelined = false;
+        else
+            units.interval = atoi(values[1].c_str());
+    }
+
+    return units.count >= 0 && units.interval > 0;
+}
+
+bool parseGeneratorMix(const string &text, GeneratorConfig &generator)
+{
+    static const char *names[] = {"add", "sub", "mul", "div", "lw", "sw"};
+    fill(begin(generator.mix), end(generator.mix), 0);
+
+    stringstream fields(text);
+    string field;
+    int total = 0;
+    while (getline(fields, field, ','))
+    {
+        size_t equals = field.find('=');
+        if (equals == string::npos)
+            return false;
+
+        string name = field.substr(0, equals);
+        int weight = atoi(field.c_str() + equals + 1);
+        auto found = find(begin(names), end(names), name);
+        if (found == end(names) || weight < 0)
+            return false;
+
+        generator.mix[found - begin(names)] = weight;
+        total += weight;
+    }
+    return total > 0;
+}
+
+bool parseGeneratorDistances(const string &text, GeneratorConfig &generator)
+{
+    generator.distances.clear();
+
+    stringstream fields(text);
+    string field;
+    int total = 0;
+    while (getline(fields, field, ','))
+    {
+        size_t equals = field.find('=');
+        if (equals == string::npos)
+            return false;
+
+        int distance = atoi(field.c_str());
+        int weight = atoi(field.c_str() + equals + 1);
+        if (distance < 0 || weight < 0)
+            return false;
+
+        generator.distances.emplace_back(distance, weight);
+        total += weight;
+    }
+    return total > 0;
+}
+
+bool parseAddressPattern(const string &text, GeneratorConfig &generator)
+{
+    stringstream fields(text);
+    string field;
+    vector<string> values;
+    while (getline(fields, field, ','))
+        values.push_back(field);
+
+    if (values.size() == 3 && values[0] == "stride")
+    {
+        generator.pattern = AddressPattern::Stride;
+        generator.stride = atoi(values[1].c_str());
+        generator.footprint = atoi(values[2].c_str());
+        return generator.stride > 0 && generator.footprint > 0;
+    }
+    if (values.size() == 2 && values[0] == "random")
+    {
+        generator.pattern = AddressPattern::Random;
+        generator.footprint = atoi(values[1].c_str());
+        return generator.footprint > 0;
+    }
+    if (values.size() == 4 && values[0] == "hot")
+    {
+        generator.pattern = AddressPattern::HotSet;
+        generator.hotSetSize = atoi(values[1].c_str());
+        generator.hotPercent = atoi(values[2].c_str());
+        generator.footprint = atoi(values[3].c_str());
+        return generator.hotSetSize > 0 && generator.hotPercent >= 0 && generator.hotPercent <= 100 && generator.footprint > 0;
+    }
+    return false;
+}
+
+bool runSweep(const string &tracePath, const SweepSpace &space, size_t threadCount, const string &outputPath)
+{
+    vector<Instruction> trace;
+    if (!loadDecodedTrace(tracePath, trace))
+        return false;
+
+    vector<TomasuloConfig> configs = space.expand();
+    vector<RunSummary> results(configs.size());
+
+    vector<function<void()>> tasks;
+    for (size_t i = 0; i < configs.size(); i++)
+    {
+        tasks.push_back([&, i]()
+                        {
+            Tomasulo simulator(configs[i]);
+            simulator.setOutputLevel(OutputLevel::Silent);
+            simulator.setEventDriven(true);
+            simulator.useInstructions(trace);
+            simulator.setInitialState(defaultInitialState());
+            simulator.run();
+            results[i] = simulator.summary(); });
+    }
+
+    WorkStealingPool pool(threadCount);
+    auto start = chrono::steady_clock::now();
+    pool.run(move(tasks));
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    FILE *output = outputPath.empty() ? stdout : fopen(outputPath.c_str(), "w");
+    if (output == nullptr)
+    {
+        cerr << "Error creating file: " << outputPath << endl;
+        return false;
+    }
+
+    for (const SweepAxis &axis : space.axes)
+        fprintf(output, "%s,", axis.column);
+    fputs("cycles,instructions,ipc,stall_rob_full,stall_no_station,stall_cdb,stall_phys_regs\n", output);
+
+    for (size_t i = 0; i < configs.size(); i++)
+    {
+        for (const SweepAxis &axis : space.axes)
+            fprintf(output, "%d,", configs[i].*axis.field);
+
+        const RunSummary &r = results[i];
+        fprintf(output, "%lld,%lld,%.4f,%lld,%lld,%lld,%lld\n", r.cycles, r.instructions, r.ipc(),
+                r.robFullStalls, r.stationFullStalls, r.cdbConflictStalls, r.physicalRegisterStalls);
+    }
+
+    if (output != stdout)
+        fclose(output);
+
+    cerr << "Simulated " << configs.size() << " configurations of " << trace.size() << " instructions on "
+         << pool.size() << " threads in " << seconds << " s" << endl;
+    return true;
+}
+
+string checkpointPath(const string &prefix, int index)
+{
+    return prefix + "." + to_string(index) + ".ckpt";
+}
+
+double studentT95(int degreesOfFreedom)
+{
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (degreesOfFreedom < 1)
+        return 0.0;
+    if (degreesOfFreedom <= 30)
+        return table[degreesOfFreedom - 1];
+    return 1.96;
+}
+
+bool runSampling(const string &tracePath, const TomasuloConfig &config, const string &prefix,
+                 long long warmup, long long window, size_t threadCount)
+{
+    vector<Instruction> trace;
+    if (!loadDecodedTrace(tracePath, trace))
+        return false;
+
+    vector<vector<char>> checkpoints;
+    for (int i = 0; access(checkpointPath(prefix, i).c_str(), R_OK) == 0; i++)
+    {
+        checkpoints.emplace_back();
+        if (!Tomasulo::readCheckpoint(checkpointPath(prefix, i), checkpoints.back()))
+            return false;
+    }
+
+    if (checkpoints.empty())
+    {
+        cerr << "No checkpoints found: " << checkpointPath(prefix, 0) << endl;
+        return false;
+    }
+
+    vector<RunSummary> results(checkpoints.size(), RunSummary{0, 0, 0, 0, 0, 0});
+    vector<char> restored(checkpoints.size(), false);
+
+    vector<function<void()>> tasks;
+    for (size_t i = 0; i < checkpoints.size(); i++)
+    {
+        tasks.push_back([&, i]()
+                        {
+            Tomasulo simulator(config);
+            simulator.setOutputLevel(OutputLevel::Silent);
+            simulator.setEventDriven(true);
+            simulator.useInstructions(trace);
+            if (!simulator.restore(checkpoints[i]))
+                return;
+
+            long long warmupEnd = simulator.committed() + warmup;
+            while (simulator.committed() < warmupEnd && simulator.step())
+            {
+            }
+
+            RunSummary before = simulator.summary();
+            long long windowStart = simulator.committed();
+            while (simulator.committed() < windowStart + window && simulator.step())
+            {
+            }
+
+            RunSummary after = simulator.summary();
+            results[i].cycles = after.cycles - before.cycles;
+            results[i].instructions = simulator.committed() - windowStart;
+            restored[i] = true; });
+    }
+
+    WorkStealingPool pool(threadCount);
+    auto start = chrono::steady_clock::now();
+    pool.run(move(tasks));
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (find(restored.begin(), restored.end(), false) != restored.end())
+        return false;
+
+    vector<double> cpis;
+    printf("checkpoint,cycles,instructions,cpi\n");
+    for (size_t i = 0; i < checkpoints.size(); i++)
+    {
+        if (results[i].instructions == 0)
+            continue;
+
+        double cpi = static_cast<double>(results[i].cycles) / results[i].instructions;
+        cpis.push_back(cpi);
+        printf("%zu,%lld,%lld,%.4f\n", i, results[i].cycles, results[i].instructions, cpi);
+    }
+
+    if (cpis.empty())
+    {
+        cerr << "No sampling window committed any instruction" << endl;
+        return false;
+    }
+
+    double mean = 0.0;
+    for (double cpi : cpis)
+        mean += cpi;
+    mean /= cpis.size();
+
+    double variance = 0.0;
+    for (double cpi : cpis)
+        variance += (cpi - mean) * (cpi - mean);
+    int n = static_cast<int>(cpis.size());
+    double halfWidth = n > 1 ? studentT95(n - 1) * sqrt(variance / (n - 1)) / sqrt(n) : 0.0;
+
+    printf("Sampled CPI: %.4f +/- %.4f (95%% confidence, %d windows of %lld instructions)\n", mean, halfWidth, n, window);
+
+    cerr << "Simulated " << checkpoints.size() << " windows on " << pool.size() << " threads in " << seconds << " s" << endl;
+    return true;
+}
+
+bool runMulticore(const MulticoreConfig &config, const string &tracePath, const GeneratorConfig &generator,
+                  const InitialState &state)
+{
+    vector<vector<Instruction>> traces;
+    if (generator.length > 0)
+    {
+        for (int i = 0; i < config.cores; i++)
+        {
+            GeneratorConfig seeded = generator;
+            seeded.seed = generator.seed + i;
+            traces.push_back(generateTrace(seeded));
+        }
+    }
+    else
+    {
+        traces.emplace_back();
+        if (!loadDecodedTrace(tracePath, traces.back()))
+            return false;
+    }
+
+    auto start = chrono::steady_clock::now();
+    MulticoreResult result = simulateMulticore(config, traces, state);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (result.cores.empty())
+        return false;
+
+    printf("core,cycles,instructions,ipc,stall_rob_full,stall_no_station,stall_cdb,stall_phys_regs\n");
+    long long coreCycles = 0;
+    for (size_t i = 0; i < result.cores.size(); i++)
+    {
+        const RunSummary &r = result.cores[i];
+        coreCycles += r.cycles;
+        printf("%zu,%lld,%lld,%.4f,%lld,%lld,%lld,%lld\n", i, r.cycles, r.instructions, r.ipc(),
+               r.robFullStalls, r.stationFullStalls, r.cdbConflictStalls, r.physicalRegisterStalls);
+    }
+
+    uint64_t checksum = 14695981039346656037ULL;
+    for (const auto &word : result.memory)
+        checksum = (checksum ^ (static_cast<uint64_t>(static_cast<uint32_t>(word.first)) << 32 | static_cast<uint32_t>(word.second))) * 1099511628211ULL;
+
+    printf("Total: %lld cycles, %lld instructions, aggregate IPC %.4f, %lld quanta of %d cycles\n",
+           result.cycles(), result.instructions(), result.ipc(), result.quanta, config.quantum);
+    printf("Shared memory: %zu nonzero words, checksum %016llx\n", result.memory.size(), static_cast<unsigned long long>(checksum));
+
+    int threadCount = min(config.cores, config.threads > 0 ? config.threads : config.cores);
+    cerr << "Simulated " << config.cores << " cores on " << threadCount << " threads in " << seconds << " s ("
+         << (seconds > 0 ? coreCycles / seconds : 0.0) << " core-cycles/s)" << endl;
+    return true;
+}
+
+vector<Instruction> syntheticKernel(const string &kind, int length)
+{
+    vector<Instruction> trace;
+    trace.reserve(length);
+    for (int i = 0; i < length; i++)
+    {
+        int8_t rd = static_cast<int8_t>(6 + i % 8);
+        if (kind == "div-bound")
+            trace.push_back({Opcode::DIV, rd, 1, 2, 0});
+        else if (kind == "load-bound")
+            trace.push_back({Opcode::LW, rd, 0, -1, (i * 16) % 4096});
+        else if (kind == "ilp-rich")
+            trace.push_back({i % 4 == 3 ? Opcode::MUL : Opcode::ADD, rd, static_cast<int8_t>(i % 5), static_cast<int8_t>((i + 1) % 5), 0});
+        else
+            trace.push_back({i % 4 == 3 ? Opcode::MUL : Opcode::ADD, 6, 6, 2, 0});
+    }
+    return trace;
+}
+
+struct BenchResult
+{
+    long long cycles;
+    long long instructions;
+    long long runs;
+    double seconds;
+    long peakRssKb;
+
+    double cyclesPerSecond() const
+    {
+        return seconds > 0 ? cycles * runs / seconds : 0.0;
+    }
+};
+
+static const double BENCH_MIN_SECONDS = 0.25;
+
+bool runBenchCase(const vector<Instruction> &trace, const TomasuloConfig &config, bool eventDriven, BenchResult &result)
+{
+    int fds[2];
+    if (pipe(fds) == -1)
+        return false;
+
+    pid_t child = fork();
+    if (child == -1)
+    {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return false;
+    }
+
+    if (child == 0)
+    {
+        ::close(fds[0]);
+        BenchResult measured = {0, 0, 0, 0.0, 0};
+        auto start = chrono::steady_clock::now();
+        do
+        {
+            Tomasulo simulator(config);
+            simulator.setOutputLevel(OutputLevel::Silent);
+            simulator.setEventDriven(eventDriven);
+            simulator.useInstructions(trace);
+            simulator.setInitialState(defaultInitialState());
+            simulator.run();
+
+            RunSummary summary = simulator.summary();
+            measured.cycles = summary.cycles;
+            measured.instructions = summary.instructions;
+            measured.runs++;
+            measured.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        } while (measured.seconds < BENCH_MIN_SECONDS);
+
+        bool ok = write(fds[1], &measured, sizeof(measured)) == sizeof(measured);
+        _exit(ok ? 0 : 1);
+    }
+
+    ::close(fds[1]);
+    bool ok = read(fds[0], &result, sizeof(result)) == sizeof(result);
+    ::close(fds[0]);
+
+    int status = 0;
+    struct rusage usage;
+    ok = wait4(child, &status, 0, &usage) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0 && ok;
+    result.peakRssKb = usage.ru_maxrss;
+    return ok;
+}
+
+struct BaselineEntry
+{
+    long long cycles;
+    double cyclesPerSecond;
+};
+
+bool loadBaseline(const string &filePath, map<string, BaselineEntry> &baseline)
+{
+    FILE *input = fopen(filePath.c_str(), "r");
+    if (input == nullptr)
+    {
+        cerr << "Error opening file: " << filePath << endl;
+        return false;
+    }
+
+    char line[512];
+    while (fgets(line, sizeof(line), input) != nullptr)
+    {
+        char workload[128], configName[128];
+        long long instructions = 0;
+        BaselineEntry entry;
+        if (sscanf(line, "%127[^,],%127[^,],%lld,%lld,%lf", workload, configName, &instructions, &entry.cycles, &entry.cyclesPerSecond) == 5)
+            baseline[string(workload) + "/" + configName] = entry;
+    }
+    fclose(input);
+    return true;
+}
+
+// Directory holding the running executable, where the benchmark workloads
+// are looked up by default; empty if it cannot be determined.
+string executableDirectory()
+{
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0)
+        return "";
+    path[length] = '\0';
+    char *slash = strrchr(path, '/');
+    return slash != nullptr ? string(path, slash - path) : "";
+}
+
+bool runBenchmark(int scale, const string &workloadDirectory, const string &baselinePath, const string &recordPath, double tolerance)
+{
+    if (workloadDirectory.empty())
+    {
+        cerr << "Benchmark workload directory unknown; pass --bench-dir" << endl;
+        return false;
+    }
+
+    vector<pair<string, vector<Instruction>>> workloads;
+    for (const char *file : {"instructions.txt", "teste.txt", "negative_address.txt"})
+    {
+        string path = workloadDirectory + "/" + file;
+        workloads.emplace_back(file, vector<Instruction>());
+        if (!loadDecodedTrace(path, workloads.back().second) || workloads.back().second.empty())
+        {
+            cerr << "Benchmark workload missing or empty: " << path << " (pass --bench-dir)" << endl;
+            return false;
+        }
+    }
+    for (const char *kind : {"div-bound", "load-bound", "ilp-rich", "serial-chain"})
+        workloads.emplace_back(kind, syntheticKernel(kind, 20000 * scale));
+
+    TomasuloConfig base;
+    TomasuloConfig wide = base;
+    wide.addStations = 8;
+    wide.mulStations = 6;
+    wide.loadStoreStations = 8;
+    wide.robSize = 64;
+    wide.issueWidth = 4;
+    wide.commitWidth = 4;
+    wide.cdbCount = 2;
+    TomasuloConfig wideCache = wide;
+    wideCache.cache.enabled = true;
+
+    struct BenchConfig
+    {
+        const char *name;
+        TomasuloConfig config;
+        bool eventDriven;
+    };
+    const BenchConfig configs[] = {{"base", base, false}, {"base-event", base, true}, {"wide", wide, true}, {"wide-cache", wideCache, true}};
+
+    map<string, BaselineEntry> baseline;
+    if (!baselinePath.empty() && !loadBaseline(baselinePath, baseline))
+        return false;
+
+    FILE *record = nullptr;
+    if (!recordPath.empty() && (record = fopen(recordPath.c_str(), "w")) == nullptr)
+    {
+        cerr << "Error creating file: " << recordPath << endl;
+        return false;
+    }
+    if (record != nullptr)
+        fputs("workload,config,instructions,cycles,sim_cycles_per_sec\n", record);
+
+    printf("workload,config,instructions,cycles,ipc,runs,host_seconds,sim_cycles_per_sec,sim_instructions_per_sec,peak_rss_kb,status\n");
+    int regressions = 0;
+    for (const auto &workload : workloads)
+    {
+        for (const BenchConfig &config : configs)
+        {
+            BenchResult result;
+            if (!runBenchCase(workload.second, config.config, config.eventDriven, result))
+            {
+                cerr << "Benchmark case failed: " << workload.first << "/" << config.name << endl;
+                return false;
+            }
+
+            string status = "ok";
+            auto it = baseline.find(workload.first + "/" + config.name);
+            if (baselinePath.empty())
+                status = "-";
+            else if (it == baseline.end())
+                status = "new";
+            else if (it->second.cycles != result.cycles)
+                status = "cycles-changed(" + to_string(it->second.cycles) + ")";
+            else if (result.cyclesPerSecond() < it->second.cyclesPerSecond * (1.0 - tolerance))
+                status = "slower";
+            if (status != "ok" && status != "-" && status != "new")
+                regressions++;
+
+            double instructionsPerSecond = result.seconds > 0 ? result.instructions * result.runs / result.seconds : 0.0;
+            printf("%s,%s,%lld,%lld,%.4f,%lld,%.3f,%.0f,%.0f,%ld,%s\n", workload.first.c_str(), config.name,
+                   result.instructions, result.cycles, result.cycles > 0 ? static_cast<double>(result.instructions) / result.cycles : 0.0,
+                   result.runs, result.seconds, result.cyclesPerSecond(), instructionsPerSecond, result.peakRssKb, status.c_str());
+            fflush(stdout);
+
+            if (record != nullptr)
+                fprintf(record, "%s,%s,%lld,%lld,%.0f\n", workload.first.c_str(), config.name, result.instructions, result.cycles, result.cyclesPerSecond());
+        }
+    }
+
+    if (record != nullptr)
+        fclose(record);
+
+    if (!baselinePath.empty())
+        cerr << regressions << " regressions against " << baselinePath << " (speed tolerance " << tolerance * 100 << "%)" << endl;
+    return regressions == 0;
+}
+
+struct CommandLine
+{
+    bool eventDriven = false;
+    OutputLevel outputLevel = OutputLevel::Full;
+    int sampleInterval = 1;
+    string stateTracePath;
+    string timelineOutput;
+    string tracePath;
+    InitialState initialState = defaultInitialState();
+    bool customState = false;
+    TomasuloConfig config;
+    string sweepTrace;
+    string sweepOutput;
+    SweepSpace sweepSpace;
+    size_t threads = max(1u, thread::hardware_concurrency());
+    string checkpointPrefix = "checkpoint";
+    long long checkpointEvery = 0;
+    string restorePath;
+    string samplingTrace;
+    long long samplingWarmup = 0;
+    long long samplingWindow = 1000;
+    long long fastForwardCount = 0;
+    long long fastForwardWarmup = 0;
+    long long detailCount = LLONG_MAX;
+    GeneratorConfig generator;
+    string generatorOutput;
+    bool benchmark = false;
+    int benchScale = 1;
+    string benchDirectory;
+    string benchBaseline;
+    string benchRecord;
+    double benchTolerance = 0.25;
+    string daemonSocket;
+    size_t traceCacheBytes = size_t(1) << 30;
+    bool multicoreRun = false;
+    MulticoreConfig multicore;
+    long long allocationWarmup = -1;
+    string timelineFile;
+    long long timelineFirst = 0;
+    long long timelineLast = LLONG_MAX;
+    bool timelineByCycles = false;
+    bool timelineSummary = false;
+};
+
+// Parses "<first>-<last>" or "<first>-" (open-ended), both inclusive.
+bool parseRange(const string &text, long long &first, long long &last)
+{
+    char *end = nullptr;
+    first = strtoll(text.c_str(), &end, 10);
+    if (end == text.c_str() || *end != '-' || first < 0)
+        return false;
+
+    if (*++end == '\0')
+    {
+        last = LLONG_MAX;
+        return true;
+    }
+
+    const char *start = end;
+    last = strtoll(start, &end, 10);
+    return end != start && *end == '\0' && last >= first;
+}
+
+bool parseCommandLine(int argc, char *argv[], CommandLine &options)
+{
+    bool validArgs = true;
+
+    for (int i = 1; i < argc && validArgs; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--event-driven")
+        {
+            options.eventDriven = true;
+        }
+        else if (arg == "--output" && hasValue)
+        {
+            string level = argv[++i];
+            if (level == "silent")
+                options.outputLevel = OutputLevel::Silent;
+            else if (level == "final")
+                options.outputLevel = OutputLevel::FinalOnly;
+            else if (level == "full")
+                options.outputLevel = OutputLevel::Full;
+            else
+                validArgs = false;
+        }
+        else if (arg == "--sample" && hasValue)
+        {
+            options.outputLevel = OutputLevel::Sampled;
+            options.sampleInterval = atoi(argv[++i]);
+            validArgs = options.sampleInterval > 0;
+        }
+        else if (arg == "--state-trace" && hasValue)
+        {
+            options.stateTracePath = argv[++i];
+        }
+        else if (arg == "--timeline-out" && hasValue)
+        {
+            options.timelineOutput = argv[++i];
+        }
+        else if (arg == "--timeline" && hasValue)
+        {
+            options.timelineFile = argv[++i];
+        }
+        else if ((arg == "--entries" || arg == "--cycles") && hasValue)
+        {
+            options.timelineByCycles = arg == "--cycles";
+            validArgs = parseRange(argv[++i], options.timelineFirst, options.timelineLast);
+        }
+        else if (arg == "--summary")
+        {
+            options.timelineSummary = true;
+        }
+        else if (arg == "--trace" && hasValue)
+        {
+            options.tracePath = argv[++i];
+        }
+        else if (arg == "--cores" && hasValue)
+        {
+            options.multicore.cores = atoi(argv[++i]);
+            validArgs = options.multicore.cores > 0;
+            options.multicoreRun = true;
+        }
+        else if (arg == "--quantum" && hasValue)
+        {
+            options.multicore.quantum = atoi(argv[++i]);
+            validArgs = options.multicore.quantum > 0;
+        }
+        else if (arg == "--init" && hasValue)
+        {
+            if (!options.customState)
+                options.initialState = InitialState();
+            options.customState = true;
+            validArgs = loadInitialState(argv[++i], options.initialState);
+        }
+        else if (arg == "--daemon" && hasValue)
+        {
+            options.daemonSocket = argv[++i];
+        }
+        else if (arg == "--trace-cache-mb" && hasValue)
+        {
+            long long megabytes = atoll(argv[++i]);
+            validArgs = megabytes > 0;
+            options.traceCacheBytes = static_cast<size_t>(megabytes) << 20;
+        }
+        else if (arg == "--sweep" && hasValue)
+        {
+            options.sweepTrace = argv[++i];
+        }
+        else if (arg == "--sweep-out" && hasValue)
+        {
+            options.sweepOutput = argv[++i];
+        }
+        else if (arg == "--checkpoint-every" && hasValue)
+        {
+            options.checkpointEvery = atoll(argv[++i]);
+            validArgs = options.checkpointEvery > 0;
+        }
+        else if (arg == "--checkpoint-prefix" && hasValue)
+        {
+            options.checkpointPrefix = argv[++i];
+        }
+        else if (arg == "--restore" && hasValue)
+        {
+            options.restorePath = argv[++i];
+        }
+        else if (arg == "--sampling" && hasValue)
+        {
+            options.samplingTrace = argv[++i];
+        }
+        else if (arg == "--warmup" && hasValue)
+        {
+            options.samplingWarmup = atoll(argv[++i]);
+            validArgs = options.samplingWarmup >= 0;
+        }
+        else if (arg == "--window" && hasValue)
+        {
+            options.samplingWindow = atoll(argv[++i]);
+            validArgs = options.samplingWindow > 0;
+        }
+        else if (arg == "--fast-forward" && hasValue)
+        {
+            string count = argv[++i];
+            options.fastForwardCount = count == "all" ? LLONG_MAX : atoll(count.c_str());
+            validArgs = options.fastForwardCount > 0;
+        }
+        else if (arg == "--ff-warmup" && hasValue)
+        {
+            options.fastForwardWarmup = atoll(argv[++i]);
+            validArgs = options.fastForwardWarmup >= 0;
+        }
+        else if (arg == "--detail" && hasValue)
+        {
+            options.detailCount = atoll(argv[++i]);
+            validArgs = options.detailCount > 0;
+        }
+        else if (arg == "--generate" && hasValue)
+        {
+            options.generator.length = strtoull(argv[++i], nullptr, 10);
+            validArgs = options.generator.length > 0;
+        }
+        else if (arg == "--gen-seed" && hasValue)
+        {
+            options.generator.seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--gen-mix" && hasValue)
+        {
+            validArgs = parseGeneratorMix(argv[++i], options.generator);
+        }
+        else if (arg == "--gen-deps" && hasValue)
+        {
+            validArgs = parseGeneratorDistances(argv[++i], options.generator);
+        }
+        else if (arg == "--gen-addr" && hasValue)
+        {
+            validArgs = parseAddressPattern(argv[++i], options.generator);
+        }
+        else if (arg == "--gen-out" && hasValue)
+        {
+            options.generatorOutput = argv[++i];
+        }
+        else if (arg == "--bench")
+        {
+            options.benchmark = true;
+        }
+        else if (arg == "--bench-scale" && hasValue)
+        {
+            options.benchScale = atoi(argv[++i]);
+            validArgs = options.benchScale > 0;
+        }
+        else if (arg == "--bench-dir" && hasValue)
+        {
+            options.benchDirectory = argv[++i];
+        }
+        else if (arg == "--bench-baseline" && hasValue)
+        {
+            options.benchBaseline = argv[++i];
+        }
+        else if (arg == "--bench-record" && hasValue)
+        {
+            options.benchRecord = argv[++i];
+        }
+        else if (arg == "--tolerance" && hasValue)
+        {
+            options.benchTolerance = atof(argv[++i]) / 100.0;
+            validArgs = options.benchTolerance >= 0.0 && options.benchTolerance < 1.0;
+        }
+        else if (arg == "--no-forwarding")
+        {
+            options.config.storeForwarding = false;
+        }
+        else if (arg == "--rename" && hasValue)
+        {
+            string mode = argv[++i];
+            if (mode == "rob")
+                options.config.renaming = RenameMode::ReorderBuffer;
+            else if (mode == "prf")
+                options.config.renaming = RenameMode::PhysicalRegisters;
+            else
+                validArgs = false;
+        }
+#ifdef TOMASULO_COUNT_ALLOCATIONS
+        else if (arg == "--check-allocations" && hasValue)
+        {
+            options.allocationWarmup = atoll(argv[++i]);
+            validArgs = options.allocationWarmup >= 0;
+        }
+#endif
+        else if (arg == "--fu-add" && hasValue)
+        {
+            validArgs = parseFunctionalUnits(argv[++i], options.config.adders);
+        }
+        else if (arg == "--fu-mul" && hasValue)
+        {
+            validArgs = parseFunctionalUnits(argv[++i], options.config.multipliers);
+        }
+        else if (arg == "--fu-div" && hasValue)
+        {
+            validArgs = parseFunctionalUnits(argv[++i], options.config.dividers);
+        }
+        else if (arg == "--predictor" && hasValue)
+        {
+            string kind = argv[++i];
+            if (kind == "static")
+                options.config.predictor.kind = PredictorKind::Static;
+            else if (kind == "bimodal")
+                options.config.predictor.kind = PredictorKind::Bimodal;
+            else if (kind == "gshare")
+                options.config.predictor.kind = PredictorKind::Gshare;
+            else
+                validArgs = false;
+        }
+        else if (arg == "--predictor-bits" && hasValue)
+        {
+            options.config.predictor.tableBits = atoi(argv[++i]);
+        }
+        else if (arg == "--history-bits" && hasValue)
+        {
+            options.config.predictor.historyBits = atoi(argv[++i]);
+        }
+        else if (arg == "--cache")
+        {
+            options.config.cache.enabled = true;
+        }
+        else if (arg == "--l1" && hasValue)
+        {
+            options.config.cache.enabled = true;
+            validArgs = parseCacheLevel(argv[++i], options.config.cache.l1);
+        }
+        else if (arg == "--l2" && hasValue)
+        {
+            options.config.cache.enabled = true;
+            validArgs = parseCacheLevel(argv[++i], options.config.cache.l2);
+        }
+        else if (arg == "--mem-latency" && hasValue)
+        {
+            options.config.cache.memoryLatency = atoi(argv[++i]);
+            validArgs = options.config.cache.memoryLatency > 0;
+        }
+        else if (arg == "--mshrs" && hasValue)
+        {
+            options.config.cache.mshrCount = atoi(argv[++i]);
+            validArgs = options.config.cache.mshrCount > 0;
+        }
+        else if (arg == "--threads" && hasValue)
+        {
+            int threads = atoi(argv[++i]);
+            validArgs = threads > 0;
+            options.threads = threads;
+            options.multicore.threads = threads;
+        }
+        else
+        {
+            SweepAxis *axis = options.sweepSpace.findAxis(arg);
+            validArgs = axis != nullptr && hasValue && parseSweepValues(argv[++i], axis->values);
+        }
+    }
+
+    options.sweepSpace.base = options.config;
+    vector<TomasuloConfig> configs = options.sweepSpace.expand();
+    if (options.sweepTrace.empty() && configs.size() != 1)
+        return false;
+    if (!validArgs || !all_of(configs.begin(), configs.end(), isValidConfig))
+        return false;
+
+    if (options.sweepTrace.empty())
+        options.config = configs.front();
+    options.multicore.core = options.config;
+    return true;
+}
+
+void printUsage(const char *program)
+{
+    cerr << "Usage: " << program << " [--trace <file>] [--init <state.txt>]... [--event-driven] [--output silent|final|full] [--sample <cycles>] [--state-trace <file.csv>] [--timeline-out <file>] [<config>]" << endl;
+    cerr << "       " << program << " --timeline <file> [--entries <first>-[<last>] | --cycles <first>-[<last>]] [--summary]" << endl;
+    cerr << "       " << program << " --convert <input.txt> <output.bin>" << endl;
+    cerr << "       " << program << " --sweep <trace> [<config>] [--threads <n>] [--sweep-out <file.csv>]" << endl;
+    cerr << "       " << program << " --sampling <trace> [<config>] [--checkpoint-prefix <p>] [--warmup <n>] [--window <n>] [--threads <n>]" << endl;
+    cerr << "       " << program << " --cores <n> [--quantum <cycles>] [--threads <n>] (--trace <file> | --generate <length> [<generator>]) [<config>]" << endl;
+    cerr << "       " << program << " --daemon <socket> [--threads <n>] [--trace-cache-mb <n>]" << endl;
+    cerr << "       " << program << " --client <socket> --trace <file> [<options>] | --stats | --quit" << endl;
+    cerr << "       " << program << " --bench [--bench-scale <n>] [--bench-dir <dir>] [--bench-baseline <file.csv>] [--bench-record <file.csv>] [--tolerance <percent>]" << endl;
+    cerr << "Generator: --generate <length> [--gen-seed <n>] [--gen-mix add=4,sub=2,mul=2,div=1,lw=3,sw=1] [--gen-deps 0=2,1=3,2=2,4=2,8=1,16=1] [--gen-addr stride,<n>,<words>|random,<words>|hot,<words>,<percent>,<words>] [--gen-out <file.bin>]" << endl;
+    cerr << "Fast-forward: --fast-forward <n>|all [--ff-warmup <n>] [--detail <n>]" << endl;
+    cerr << "Checkpoints: --checkpoint-every <instructions> [--checkpoint-prefix <p>] | --restore <file.ckpt>" << endl;
+    cerr << "Config: --add --mul --ls --rob --lat-add --lat-mul --lat-div --lat-ls --issue-width --commit-width --cdbs --phys-regs <values>" << endl;
+    cerr << "        values: 1,2,4 | 2-8 | 2-32:2 (lists and ranges only with --sweep; --cdbs 0 = unlimited; --phys-regs 0 = 32 + ROB size)" << endl;
+    cerr << "Renaming: --rename rob|prf (prf: map table + physical register file of --phys-regs registers)" << endl;
+    cerr << "Functional units: --fu-add|--fu-mul|--fu-div <count>[,<interval>|,unpipelined] (0 = execute in the reservation station)" << endl;
+    cerr << "Memory options: --no-forwarding" << endl;
+    cerr << "Branch options: --predictor static|bimodal|gshare [--predictor-bits <n>] [--history-bits <n>]" << endl;
+    cerr << "Cache options: --cache [--l1|--l2 <bytes>,<ways>,<line>,<latency>[,lru|fifo|random]] [--mem-latency <n>] [--mshrs <n>]" << endl;
+#ifdef TOMASULO_COUNT_ALLOCATIONS
+    cerr << "Allocation check: --check-allocations <warm-up cycles> (fails if the run allocates after warm-up)" << endl;
+    cerr << "                  without --trace or --generate, runs the built-in generated and .bin cases" << endl;
+#endif
+}
+
+#ifdef TOMASULO_COUNT_ALLOCATIONS
+bool runAllocationCheck(Tomasulo &simulator, const CommandLine &options)
+{
+    simulator.setInitialState(options.initialState);
+    simulator.runUntil(options.allocationWarmup);
+    long long before = threadAllocations();
+    simulator.runUntil(LLONG_MAX);
+    long long allocated = threadAllocations() - before;
+    simulator.finish();
+
+    cerr << "Allocations after " << options.allocationWarmup << " warm-up cycles: " << allocated << endl;
+    return allocated == 0;
+}
+
+// Regression cases for the allocation check: a generated trace, the same
+// trace reloaded from its .bin file, a streamed text trace, and the output
+// modes and timeline file over them. Every case must report no allocations
+// after warm-up.
+bool runAllocationSuite(const CommandLine &options)
+{
+    enum class Source
+    {
+        Generated,
+        Binary,
+        Text
+    };
+    struct Case
+    {
+        const char *name;
+        Source source;
+        OutputLevel level;
+        int sampleInterval;
+        bool eventDriven;
+        bool timelineFile;
+    };
+    static const Case cases[] = {
+        {"generated, silent", Source::Generated, OutputLevel::Silent, 1, false, false},
+        {"generated, final", Source::Generated, OutputLevel::FinalOnly, 1, false, false},
+        {"binary, silent", Source::Binary, OutputLevel::Silent, 1, false, false},
+        {"binary, final", Source::Binary, OutputLevel::FinalOnly, 1, false, false},
+        {"binary, full", Source::Binary, OutputLevel::Full, 1, false, false},
+        {"binary, sampled", Source::Binary, OutputLevel::Sampled, 1000, false, false},
+        {"binary, event-driven", Source::Binary, OutputLevel::Silent, 1, true, false},
+        {"binary, timeline file", Source::Binary, OutputLevel::Silent, 1, false, true},
+        {"text, silent", Source::Text, OutputLevel::Silent, 1, false, false},
+        {"text, final", Source::Text, OutputLevel::FinalOnly, 1, false, false},
+        {"text, timeline file", Source::Text, OutputLevel::Silent, 1, false, true},
+    };
+
+    string prefix = "/tmp/tomasulo_alloc_" + to_string(getpid());
+    string tracePath = prefix + ".bin";
+    string textPath = prefix + ".txt";
+    string timelinePath = prefix + ".timeline";
+
+    GeneratorConfig generator;
+    generator.length = 200000;
+
+    {
+        ofstream text(textPath);
+        for (const Instruction &instruction : generateTrace(generator))
+            text << formatInstruction(instruction) << "\n";
+    }
+
+    ofstream discard("/dev/null");
+    bool passed = true;
+    for (const Case &test : cases)
+    {
+        Tomasulo simulator(options.config);
+        simulator.setEventDriven(test.eventDriven);
+        simulator.setOutputLevel(test.level, test.sampleInterval);
+        simulator.setOutputStream(discard);
+
+        bool ready = test.timelineFile ? simulator.setTimelineFile(timelinePath) : true;
+        if (ready)
+        {
+            if (test.source == Source::Generated)
+                ready = simulator.generateInstructions(generator, tracePath);
+            else
+                ready = simulator.loadInstructions(test.source == Source::Binary ? tracePath : textPath);
+        }
+        if (!ready)
+        {
+            cerr << test.name << ": could not set up the run" << endl;
+            passed = false;
+            continue;
+        }
+
+        cerr << test.name << ": ";
+        passed = runAllocationCheck(simulator, options) && passed;
+    }
+
+    remove(tracePath.c_str());
+    remove(textPath.c_str());
+    remove(timelinePath.c_str());
+    return passed;
+}
+#endif
+
+bool runTimelineQuery(const CommandLine &options)
+{
+    long long first = options.timelineFirst;
+    long long last = options.timelineLast;
+    if (options.timelineByCycles && !findTimelineCycles(options.timelineFile, first, last, first, last))
+        return false;
+
+    if (!options.timelineSummary)
+    {
+        vector<InstructionStatus> entries;
+        if (!readTimeline(options.timelineFile, first, last, entries))
+            return false;
+
+        cout << "Entry\tInstruction\t\tIssue\tExecComp\tWriteRes\tCommit" << endl;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            cout << first + static_cast<long long>(i) << "\t" << formatInstruction(entries[i].instruction)
+                 << "\t\t" << entries[i].issueTime << "\t"
+                 << entries[i].execCompleteTime << "\t\t"
+                 << entries[i].writeResultTime << "\t\t"
+                 << entries[i].commitTime << endl;
+        }
+        return true;
+    }
+
+    TimelineSummary summary;
+    if (!summarizeTimeline(options.timelineFile, first, last, summary))
+        return false;
+
+    cout << "Instructions: " << summary.instructions << endl;
+    if (summary.instructions == 0)
+        return true;
+
+    long long cycles = summary.lastCommit - summary.firstIssue + 1;
+    cout << "Cycles: " << summary.firstIssue << "-" << summary.lastCommit << " (IPC "
+         << static_cast<double>(summary.instructions) / cycles << ")" << endl;
+    cout << "\nAverage cycles per stage:" << endl;
+    cout << "Opcode\tCount\tExecute\tResult\tCommit" << endl;
+    for (int op = 0; op < OPCODE_COUNT; op++)
+    {
+        long long count = summary.count[op];
+        if (count == 0)
+            continue;
+
+        cout << opcodeName(static_cast<Opcode>(op)) << "\t" << count << "\t"
+             << static_cast<double>(summary.executeCycles[op]) / count << "\t"
+             << static_cast<double>(summary.resultCycles[op]) / count << "\t"
+             << static_cast<double>(summary.commitCycles[op]) / count << endl;
+    }
+    return true;
+}
+
+bool runSimulation(Tomasulo &simulator, const CommandLine &options)
+{
+    if (options.restorePath.empty())
+        simulator.setInitialState(options.initialState);
+    else if (!simulator.restoreCheckpoint(options.restorePath))
+        return false;
+
+    if (options.checkpointEvery == 0 && options.fastForwardCount == 0)
+    {
+        simulator.run();
+        return true;
+    }
+
+    auto after = [&simulator](long long count)
+    {
+        return count > LLONG_MAX - simulator.committed() ? LLONG_MAX : simulator.committed() + count;
+    };
+
+    long long nextCheckpoint = options.checkpointEvery > 0 ? after(options.checkpointEvery) : LLONG_MAX;
+    int written = 0;
+    bool functional = options.fastForwardCount > 0;
+    long long phaseEnd = after(functional ? options.fastForwardCount : options.detailCount);
+
+    while (!simulator.completed())
+    {
+        long long target = min(phaseEnd, nextCheckpoint);
+        if (functional)
+        {
+            long long count = target - simulator.committed();
+            long long warmup = max(0LL, min(count, options.fastForwardWarmup - (phaseEnd - target)));
+            if (simulator.fastForward(count, warmup) < count && !simulator.completed())
+                break;
+        }
+        else
+        {
+            while (simulator.committed() < target && simulator.step())
+            {
+            }
+        }
+
+        if (simulator.committed() >= nextCheckpoint)
+        {
+            if (!simulator.saveCheckpoint(checkpointPath(options.checkpointPrefix, written++)))
+                return false;
+            nextCheckpoint = after(options.checkpointEvery);
+        }
+
+        if (simulator.committed() >= phaseEnd)
+        {
+            functional = !functional && options.fastForwardCount > 0;
+            phaseEnd = after(functional ? options.fastForwardCount : options.detailCount);
+        }
+    }
+    simulator.finish();
+    return true;
+}
+
+class SocketBuffer : public streambuf
+{
+private:
+    int fd;
+    bool failed;
+    char buffer[1 << 16];
+
+    bool flushBuffer()
+    {
+        const char *p = pbase();
+        size_t remaining = pptr() - pbase();
+        while (remaining > 0 && !failed)
+        {
+            ssize_t sent = send(fd, p, remaining, MSG_NOSIGNAL);
+            if (sent == -1 && errno == EINTR)
+                continue;
+            if (sent <= 0)
+                failed = true;
+            else
+            {
+                p += sent;
+                remaining -= sent;
+            }
+        }
+        setp(buffer, buffer + sizeof(buffer));
+        return !failed;
+    }
+
+protected:
+    int overflow(int c) override
+    {
+        if (!flushBuffer())
+            return traits_type::eof();
+
+        if (c != traits_type::eof())
+        {
+            *pptr() = static_cast<char>(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override
+    {
+        return flushBuffer() ? 0 : -1;
+    }
+
+public:
+    explicit SocketBuffer(int fd) : fd(fd), failed(false)
+    {
+        setp(buffer, buffer + sizeof(buffer));
+    }
+
+    ~SocketBuffer()
+    {
+        flushBuffer();
+    }
+};
+
+class TraceCache
+{
+private:
+    using TracePtr = shared_ptr<const vector<Instruction>>;
+
+    struct Entry
+    {
+        string key;
+        shared_future<TracePtr> trace;
+        size_t bytes;
+    };
+
+    mutex lock;
+    list<Entry> entries;
+    map<string, list<Entry>::iterator> index;
+    size_t capacityBytes;
+    size_t usedBytes;
+    long long hits;
+    long long misses;
+    long long evictions;
+
+    static bool inUse(const Entry &entry)
+    {
+        if (entry.trace.wait_for(chrono::seconds(0)) != future_status::ready)
+            return true;
+        return entry.trace.get().use_count() > 1;
+    }
+
+    void evict()
+    {
+        auto it = entries.end();
+        while (usedBytes > capacityBytes && it != entries.begin())
+        {
+            --it;
+            if (inUse(*it))
+                continue;
+
+            usedBytes -= it->bytes;
+            index.erase(it->key);
+            it = entries.erase(it);
+            evictions++;
+        }
+    }
+
+public:
+    explicit TraceCache(size_t capacityBytes)
+        : capacityBytes(capacityBytes), usedBytes(0), hits(0), misses(0), evictions(0) {}
+
+    TracePtr acquire(const string &filePath)
+    {
+        struct stat info;
+        if (stat(filePath.c_str(), &info) == -1)
+            return nullptr;
+
+        string key = filePath + "|" + to_string(info.st_mtim.tv_sec) + "." + to_string(info.st_mtim.tv_nsec) + "|" + to_string(info.st_size);
+
+        promise<TracePtr> loading;
+        shared_future<TracePtr> trace;
+        {
+            lock_guard<mutex> guard(lock);
+            auto found = index.find(key);
+            if (found != index.end())
+            {
+                entries.splice(entries.begin(), entries, found->second);
+                hits++;
+                trace = found->second->trace;
+            }
+            else
+            {
+                misses++;
+                entries.push_front({key, loading.get_future().share(), 0});
+                index[key] = entries.begin();
+            }
+        }
+
+        if (trace.valid())
+            return trace.get();
+
+        auto decoded = make_shared<vector<Instruction>>();
+        TracePtr result;
+        if (loadDecodedTrace(filePath, *decoded))
+        {
+            decoded->shrink_to_fit();
+            result = decoded;
+        }
+        loading.set_value(result);
+
+        lock_guard<mutex> guard(lock);
+        auto found = index.find(key);
+        if (result == nullptr)
+        {
+            entries.erase(found->second);
+            index.erase(found);
+        }
+        else
+        {
+            found->second->bytes = result->size() * sizeof(Instruction);
+            usedBytes += found->second->bytes;
+            evict();
+        }
+        return result;
+    }
+
+    string statistics()
+    {
+        lock_guard<mutex> guard(lock);
+        return "traces " + to_string(entries.size()) + ", bytes " + to_string(usedBytes) + " of " + to_string(capacityBytes) +
+               ", hits " + to_string(hits) + ", misses " + to_string(misses) + ", evictions " + to_string(evictions);
+    }
+};
+
+bool readRequestLine(int fd, string &line)
+{
+    static const size_t MAX_REQUEST = 1 << 16;
+    line.clear();
+    char c;
+    while (line.size() < MAX_REQUEST)
+    {
+        ssize_t received = recv(fd, &c, 1, 0);
+        if (received == -1 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return !line.empty();
+        if (c == '\n')
+            return true;
+        line.push_back(c);
+    }
+    return false;
+}
+
+bool sendText(int fd, const string &text)
+{
+    size_t offset = 0;
+    while (offset < text.size())
+    {
+        ssize_t sent = send(fd, text.data() + offset, text.size() - offset, MSG_NOSIGNAL);
+        if (sent == -1 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        offset += sent;
+    }
+    return true;
+}
+
+bool serveJob(int fd, TraceCache &cache, atomic<bool> &stopping)
+{
+    string line;
+    if (!readRequestLine(fd, line))
+        return true;
+
+    istringstream tokens(line);
+    vector<string> args = {"tomasulo"};
+    string token;
+    while (tokens >> token)
+        args.push_back(token);
+
+    if (args.size() == 2 && args[1] == "--quit")
+    {
+        sendText(fd, "OK\n");
+        return false;
+    }
+
+    if (args.size() == 2 && args[1] == "--stats")
+    {
+        sendText(fd, "OK\n" + cache.statistics() + "\n");
+        return true;
+    }
+
+    vector<char *> argv;
+    for (string &arg : args)
+        argv.push_back(&arg[0]);
+
+    CommandLine options;
+    if (!parseCommandLine(static_cast<int>(argv.size()), argv.data(), options) || !options.daemonSocket.empty() ||
+        options.benchmark || options.multicoreRun || !options.sweepTrace.empty() || !options.samplingTrace.empty() ||
+        !options.timelineFile.empty() ||
+        (options.tracePath.empty() && options.generator.length == 0))
+    {
+        sendText(fd, "ERROR invalid job: " + line + "\n");
+        return true;
+    }
+
+    // Jobs run as the daemon user, so a client may not name files for the
+    // daemon to create; results come back only over the socket.
+    if (!options.stateTracePath.empty() || !options.timelineOutput.empty() || !options.generatorOutput.empty() ||
+        options.checkpointEvery > 0)
+    {
+        sendText(fd, "ERROR output files are not allowed in daemon jobs: " + line + "\n");
+        return true;
+    }
+
+    shared_ptr<const vector<Instruction>> trace;
+    if (options.generator.length == 0 && (trace = cache.acquire(options.tracePath)) == nullptr)
+    {
+        sendText(fd, "ERROR cannot load trace: " + options.tracePath + "\n");
+        return true;
+    }
+
+    if (!sendText(fd, "OK\n"))
+        return true;
+
+    SocketBuffer buffer(fd);
+    ostream output(&buffer);
+
+    Tomasulo simulator(options.config);
+    simulator.setOutputStream(output);
+    simulator.setEventDriven(options.eventDriven);
+    simulator.setOutputLevel(options.outputLevel, options.sampleInterval);
+
+    bool ok = true;
+    if (trace != nullptr)
+        simulator.useInstructions(*trace);
+    else
+        ok = simulator.generateInstructions(options.generator);
+
+    if (!ok || !runSimulation(simulator, options))
+        output << "\nERROR job failed" << endl;
+    output.flush();
+    return !stopping.load();
+}
+
+bool runDaemon(const string &socketPath, size_t threadCount, size_t cacheBytes)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        cerr << "Socket path too long: " << socketPath << endl;
+        return false;
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == -1)
+    {
+        cerr << "Error creating socket" << endl;
+        return false;
+    }
+
+    // Only the daemon user may connect: the socket is created with mode 0600.
+    unlink(socketPath.c_str());
+    mode_t previousMask = umask(0177);
+    bool bound = bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+    umask(previousMask);
+    if (!bound || listen(listener, 128) == -1)
+    {
+        cerr << "Error binding socket: " << socketPath << endl;
+        ::close(listener);
+        return false;
+    }
+
+    TraceCache cache(cacheBytes);
+    mutex queueLock;
+    condition_variable queueReady;
+    deque<int> pending;
+    atomic<bool> stopping(false);
+
+    vector<thread> workers;
+    for (size_t i = 0; i < max<size_t>(1, threadCount); i++)
+    {
+        workers.emplace_back([&]()
+                             {
+            while (true)
+            {
+                int client;
+                {
+                    unique_lock<mutex> guard(queueLock);
+                    queueReady.wait(guard, [&]() { return !pending.empty() || stopping.load(); });
+                    if (pending.empty())
+                        return;
+                    client = pending.front();
+                    pending.pop_front();
+                }
+
+                if (!serveJob(client, cache, stopping) && !stopping.exchange(true))
+                {
+                    shutdown(listener, SHUT_RDWR);
+                    queueReady.notify_all();
+                }
+                ::close(client);
+            } });
+    }
+
+    cerr << "Listening on " << socketPath << " with " << workers.size() << " workers" << endl;
+    while (!stopping.load())
+    {
+        int client = accept(listener, nullptr, nullptr);
+        if (client == -1)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+
+        lock_guard<mutex> guard(queueLock);
+        pending.push_back(client);
+        queueReady.notify_one();
+    }
+
+    {
+        lock_guard<mutex> guard(queueLock);
+        stopping.store(true);
+    }
+    queueReady.notify_all();
+    for (thread &worker : workers)
+        worker.join();
+
+    ::close(listener);
+    unlink(socketPath.c_str());
+    return true;
+}
+
+bool runClient(const string &socketPath, int argc, char *argv[])
+{
+    string request;
+    for (int i = 0; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (i > 0 && string(argv[i - 1]) == "--trace")
+        {
+            char resolved[PATH_MAX];
+            if (realpath(arg.c_str(), resolved) != nullptr)
+                arg = resolved;
+        }
+        request += (i > 0 ? " " : "") + arg;
+    }
+    request += "\n";
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        cerr << "Socket path too long: " << socketPath << endl;
+        return false;
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1)
+    {
+        cerr << "Error connecting to " << socketPath << endl;
+        if (fd != -1)
+            ::close(fd);
+        return false;
+    }
+
+    string status;
+    bool ok = sendText(fd, request) && readRequestLine(fd, status) && status == "OK";
+    if (!ok)
+        cerr << (status.empty() ? "No response from " + socketPath : status) << endl;
+
+    char buffer[1 << 16];
+    ssize_t received;
+    while (ok && (received = recv(fd, buffer, sizeof(buffer), 0)) != 0)
+    {
+        if (received == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            ok = false;
+            break;
+        }
+        fwrite(buffer, 1, received, stdout);
+    }
+
+    ::close(fd);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 4 && string(argv[1]) == "--convert")
+    {
+        return convertTextTrace(argv[2], argv[3]) ? 0 : 1;
+    }
+
+    if (argc >= 3 && string(argv[1]) == "--client")
+    {
+        return runClient(argv[2], argc - 3, argv + 3) ? 0 : 1;
+    }
+
+    CommandLine options;
+    if (!parseCommandLine(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (!options.daemonSocket.empty())
+        return runDaemon(options.daemonSocket, options.threads, options.traceCacheBytes) ? 0 : 1;
+
+    if (!options.timelineFile.empty())
+        return runTimelineQuery(options) ? 0 : 1;
+
+    if (options.benchmark)
+    {
+        string workloadDirectory = options.benchDirectory.empty() ? executableDirectory() : options.benchDirectory;
+        return runBenchmark(options.benchScale, workloadDirectory, options.benchBaseline, options.benchRecord, options.benchTolerance) ? 0 : 1;
+    }
+
+    if (!options.sweepTrace.empty())
+        return runSweep(options.sweepTrace, options.sweepSpace, options.threads, options.sweepOutput) ? 0 : 1;
+
+    if (!options.samplingTrace.empty())
+        return runSampling(options.samplingTrace, options.config, options.checkpointPrefix, options.samplingWarmup, options.samplingWindow, options.threads) ? 0 : 1;
+
+    if (options.multicoreRun)
+    {
+        if (options.tracePath.empty() && options.generator.length == 0)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runMulticore(options.multicore, options.tracePath, options.generator, options.initialState) ? 0 : 1;
+    }
+
+#ifdef TOMASULO_COUNT_ALLOCATIONS
+    if (options.allocationWarmup >= 0 && options.tracePath.empty() && options.generator.length == 0)
+        return runAllocationSuite(options) ? 0 : 1;
+#endif
+
+    Tomasulo simulator(options.config);
+    simulator.setEventDriven(options.eventDriven);
+    simulator.setOutputLevel(options.outputLevel, options.sampleInterval);
+
+    if (!options.stateTracePath.empty() && !simulator.setStateTrace(options.stateTracePath))
+        return 1;
+    if (!options.timelineOutput.empty() && !simulator.setTimelineFile(options.timelineOutput))
+        return 1;
+
+    if (options.generator.length > 0)
+    {
+        if (!simulator.generateInstructions(options.generator, options.generatorOutput))
+            return 1;
+    }
+    else
+    {
+        string filePath = options.tracePath;
+        if (filePath.empty())
+        {
+            cout << "Enter the file path:" << endl;
+            cin >> filePath;
+            cin.ignore();
+        }
+
+        if (!simulator.loadInstructions(filePath))
+        {
+            cerr << "Error loading instructions.";
+            return 1;
+        }
+    }
+
+#ifdef TOMASULO_COUNT_ALLOCATIONS
+    if (options.allocationWarmup >= 0)
+        return runAllocationCheck(simulator, options) ? 0 : 1;
+#endif
+
+    return runSimulation(simulator, options) ? 0 : 1;
+}
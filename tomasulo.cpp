@@ -1,813 +1,5498 @@
+#include "tomasulo.h"
+
 #include <iostream>
-#include <fstream>
 #include <sstream>
-#include <queue>
+#include <fstream>
 #include <vector>
-#include <unordered_map>
-#include <unordered_set>
+#include <map>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <array>
+#include <cstdint>
+#include <climits>
+#include <type_traits>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
-struct Instruction
-{
-    string op;
-    string rd;
-    string rs1;
-    string rs2;
-    string imm;
+#ifdef TOMASULO_NO_STATS
+#define TOMASULO_STAT(statement)
+#else
+#define TOMASULO_STAT(statement) statement
+#endif
 
-    Instruction(string op, string rd, string rs1, string rs2, string imm)
-        : op(op), rd(rd), rs1(rs1), rs2(rs2), imm(imm) {}
+enum class InstrType : uint8_t
+{
+    Arith,
+    Load,
+    Store,
+    Branch
 };
 
-struct InstructionStatus
+const char *opcodeName(Opcode op)
 {
-    Instruction instruction;
-    int issueTime, execCompleteTime, writeResultTime, commitTime;
-
-    InstructionStatus(Instruction instruction)
-        : instruction(instruction), issueTime(-1), execCompleteTime(-1), writeResultTime(-1), commitTime(-1) {}
-};
+    switch (op)
+    {
+    case Opcode::ADD:
+        return "ADD";
+    case Opcode::SUB:
+        return "SUB";
+    case Opcode::MUL:
+        return "MUL";
+    case Opcode::DIV:
+        return "DIV";
+    case Opcode::LW:
+        return "LW";
+    case Opcode::SW:
+        return "SW";
+    case Opcode::BEQ:
+        return "BEQ";
+    case Opcode::BNE:
+        return "BNE";
+    case Opcode::J:
+        return "J";
+    }
+    return "?";
+}
 
-struct ROBEntry
+bool isBranch(Opcode op)
 {
-    bool busy;
-    bool ready;
-    string destination;
-    int value;
-    string type;
-    int instructionIndex;
-};
+    return op == Opcode::BEQ || op == Opcode::BNE || op == Opcode::J;
+}
 
-struct ReservationStation
+// Registers are 32 bits and wrap around on overflow. The arithmetic is done
+// in uint32_t, where overflow is defined, so results are the same with every
+// compiler and optimization level.
+int wrappingAdd(int a, int b)
 {
-    string name;
-    string op;
-    int qj, qk;
-    int vj, vk;
-    int destRobTag;
-    string addr;
-    string imm;
-    bool busy;
-    int instructionIndex;
-    int remainingCycles;
+    return static_cast<int>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+}
 
-    ReservationStation(string name)
-        : name(name), op(""), qj(-1), qk(-1), vj(0), vk(0), destRobTag(-1), addr(""), imm(""),
-          busy(false), instructionIndex(-1), remainingCycles(-1) {}
+// Result of ADD, SUB, MUL or DIV; a zero divisor gives 0, and INT_MIN / -1
+// wraps to INT_MIN.
+int arithmeticResult(Opcode op, int a, int b)
+{
+    switch (op)
+    {
+    case Opcode::ADD:
+        return wrappingAdd(a, b);
+    case Opcode::SUB:
+        return static_cast<int>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b));
+    case Opcode::MUL:
+        return static_cast<int>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b));
+    case Opcode::DIV:
+        if (b == 0)
+            return 0;
+        return b == -1 ? static_cast<int>(0u - static_cast<uint32_t>(a)) : a / b;
+    default:
+        return 0;
+    }
+}
 
-    void reset()
+const char *instrTypeName(InstrType type)
+{
+    switch (type)
     {
-        op = "";
-        qj = qk = -1;
-        vj = vk = 0;
-        destRobTag = -1;
-        addr = "";
-        imm = "";
-        busy = false;
-        instructionIndex = -1;
-        remainingCycles = -1;
+    case InstrType::Arith:
+        return "arith";
+    case InstrType::Load:
+        return "load";
+    case InstrType::Store:
+        return "store";
+    case InstrType::Branch:
+        return "branch";
     }
-};
+    return "?";
+}
 
-struct Register
+bool parseOpcode(const string &text, Opcode &op)
 {
-    int robTag;
-    int value;
+    static const pair<const char *, Opcode> table[] = {
+        {"ADD", Opcode::ADD}, {"SUB", Opcode::SUB}, {"MUL", Opcode::MUL},
+        {"DIV", Opcode::DIV}, {"LW", Opcode::LW}, {"SW", Opcode::SW},
+        {"BEQ", Opcode::BEQ}, {"BNE", Opcode::BNE}, {"J", Opcode::J}};
 
-    Register() : robTag(-1), value(0) {}
-};
+    for (const auto &entry : table)
+    {
+        if (text == entry.first)
+        {
+            op = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
 
-class Tomasulo
+int parseRegister(const string &name)
 {
-private:
-    queue<Instruction> instructions;
-    vector<InstructionStatus> instructionsStatus;
-    vector<ReservationStation> addRS;
-    vector<ReservationStation> mulRS;
-    vector<ReservationStation> loadStoreRS;
-    vector<ROBEntry> rob;
-    unordered_map<string, Register> registers;
-    unordered_map<string, int> memory;
-    unordered_set<string> usedRegisters;
+    if (name.size() < 2 || name[0] != 'R')
+        return -1;
 
-    int cycle;
-    bool isCompleted;
-    int robSize;
-    int robHead, robTail;
+    int index = 0;
+    for (size_t i = 1; i < name.size(); i++)
+    {
+        if (name[i] < '0' || name[i] > '9')
+            return -1;
+        index = index * 10 + (name[i] - '0');
+        if (index >= NUM_REGISTERS)
+            return -1;
+    }
+    return index;
+}
 
-    static const int ADD_SUB_LATENCY = 2;
-    static const int MUL_LATENCY = 10;
-    static const int DIV_LATENCY = 40;
-    static const int LOAD_STORE_LATENCY = 2;
+string registerName(int index)
+{
+    return "R" + to_string(index);
+}
 
-public:
-    Tomasulo(int addQuantity, int mulQuantity, int loadStoreQuantity, int robSize = 6)
-        : cycle(0), isCompleted(false), robSize(robSize), robHead(0), robTail(0)
-    {
-        rob.resize(robSize);
-        addRS.reserve(addQuantity);
-        mulRS.reserve(mulQuantity);
-        loadStoreRS.reserve(loadStoreQuantity);
+string formatInstruction(const Instruction &instr)
+{
+    string text = opcodeName(instr.op);
+    if (instr.op == Opcode::LW)
+        return text + " " + registerName(instr.rd) + " " + registerName(instr.rs1) + " " + to_string(instr.imm);
+    if (instr.op == Opcode::SW)
+        return text + " " + registerName(instr.rs2) + " " + registerName(instr.rs1) + " " + to_string(instr.imm);
+    if (instr.op == Opcode::J)
+        return text + " " + to_string(instr.imm);
+    if (isBranch(instr.op))
+        return text + " " + registerName(instr.rs1) + " " + registerName(instr.rs2) + " " + to_string(instr.imm);
+    return text + " " + registerName(instr.rd) + " " + registerName(instr.rs1) + " " + registerName(instr.rs2);
+}
 
-        for (int i = 0; i < addQuantity; i++)
+bool resolveLabel(const string &label, const map<string, int> *labels, int32_t &target)
+{
+    if (labels != nullptr)
+    {
+        auto it = labels->find(label);
+        if (it != labels->end())
         {
-            addRS.emplace_back("ADD" + to_string(i + 1));
+            target = it->second;
+            return true;
         }
+    }
 
-        for (int i = 0; i < mulQuantity; i++)
-        {
-            mulRS.emplace_back("MUL" + to_string(i + 1));
-        }
+    cerr << "Unknown label: " << label << endl;
+    return false;
+}
 
-        for (int i = 0; i < loadStoreQuantity; i++)
-        {
-            loadStoreRS.emplace_back("LOAD" + to_string(i + 1));
-        }
+bool decodeBranch(istringstream &iss, const string &line, const map<string, int> *labels, Instruction &instruction)
+{
+    instruction.rd = -1;
+    instruction.rs1 = -1;
+    instruction.rs2 = -1;
 
-        for (int i = 0; i < 32; i++)
+    string first, second, target;
+    if (instruction.op == Opcode::J)
+    {
+        if (!(iss >> target))
         {
-            string name = "R" + to_string(i);
-            registers[name] = Register();
+            cerr << "Malformed instruction: " << line << endl;
+            return false;
         }
+        return resolveLabel(target, labels, instruction.imm);
     }
 
-    bool loadInstructions(const string &filePath)
+    if (!(iss >> first >> second >> target))
     {
-        ifstream file(filePath);
+        cerr << "Malformed instruction: " << line << endl;
+        return false;
+    }
 
-        if (!file.is_open())
-        {
-            cerr << "Error opening file: " << filePath << endl;
-            return false;
-        }
+    int a = parseRegister(first);
+    int b = parseRegister(second);
+    if (a == -1 || b == -1)
+    {
+        cerr << "Invalid register: " << (a == -1 ? first : second) << endl;
+        return false;
+    }
 
-        string line;
-        while (getline(file, line))
-        {
-            if (line.empty() || line[0] == '#')
-                continue;
+    instruction.rs1 = a;
+    instruction.rs2 = b;
+    return resolveLabel(target, labels, instruction.imm);
+}
 
-            istringstream iss(line);
-            string op, rd, rs1, rs2, imm;
-            iss >> op;
+bool decodeInstruction(const string &line, Instruction &instruction, const map<string, int> *labels = nullptr)
+{
+    istringstream iss(line);
+    string op, first, second, third;
+    iss >> op;
 
-            if (op == "ADD" || op == "SUB" || op == "MUL" || op == "DIV")
-            {
-                iss >> rd >> rs1 >> rs2;
-                imm = "";
+    if (!parseOpcode(op, instruction.op))
+    {
+        cerr << "Unknown instruction: " << op << endl;
+        return false;
+    }
 
-                usedRegisters.insert(rd);
-                usedRegisters.insert(rs1);
-                usedRegisters.insert(rs2);
-            }
-            else if (op == "LW")
-            {
-                iss >> rd >> rs1 >> imm;
-                rs2 = "";
+    if (isBranch(instruction.op))
+        return decodeBranch(iss, line, labels, instruction);
 
-                usedRegisters.insert(rd);
-                usedRegisters.insert(rs1);
-            }
-            else if (op == "SW")
-            {
-                iss >> rs2 >> rs1 >> imm;
-                rd = rs2;
+    if (!(iss >> first >> second >> third))
+    {
+        cerr << "Malformed instruction: " << line << endl;
+        return false;
+    }
 
-                usedRegisters.insert(rd);
-                usedRegisters.insert(rs1);
-            }
-            else
-            {
-                cerr << "Unknown instruction: " << op << endl;
-                continue;
-            }
+    int a = parseRegister(first);
+    int b = parseRegister(second);
+    int c = -1;
+    instruction.imm = 0;
 
-            instructions.push(Instruction(op, rd, rs1, rs2, imm));
+    if (instruction.op == Opcode::LW || instruction.op == Opcode::SW)
+    {
+        char *end = nullptr;
+        long imm = strtol(third.c_str(), &end, 10);
+        if (*end != '\0')
+        {
+            cerr << "Invalid immediate: " << third << endl;
+            return false;
         }
-
-        file.close();
-        return true;
+        instruction.imm = static_cast<int32_t>(imm);
     }
-
-    void run()
+    else
     {
-        while (!isCompleted)
+        c = parseRegister(third);
+        if (c == -1)
         {
-            cout << "\n=== Cycle " << cycle + 1 << " ===" << endl;
-
-            commit();
-            writeResults();
-            executeInstructions();
-            issueInstruction();
-
-            printState();
-            cycle++;
-            isCompleted = checkSimulationComplete();
+            cerr << "Invalid register: " << third << endl;
+            return false;
         }
-
-        printFinalResults();
     }
 
-    void setRegister(string index, int value) 
+    if (a == -1 || b == -1)
     {
-        registers[index].value = value;
+        cerr << "Invalid register: " << (a == -1 ? first : second) << endl;
+        return false;
     }
 
-
-    void setMemory(string index, int value)
+    if (instruction.op == Opcode::SW)
     {
-        memory[index] = value;
+        instruction.rd = -1;
+        instruction.rs1 = b;
+        instruction.rs2 = a;
     }
-
-private:
-    void issueInstruction()
+    else
     {
-        if (instructions.empty())
-            return;
+        instruction.rd = a;
+        instruction.rs1 = b;
+        instruction.rs2 = c;
+    }
+    return true;
+}
 
-        if (rob[robTail].busy)
-            return;
+// Length of the label definition at the start of a line ("loop:" as the
+// first token), or 0 when the line has none or is a comment.
+// Offset of the first character of a line that is not leading whitespace.
+static size_t indentOf(const char *line, size_t length)
+{
+    size_t start = 0;
+    while (start < length && (line[start] == ' ' || line[start] == '\t' || line[start] == '\r'))
+        start++;
+    return start;
+}
 
-        Instruction instruction = instructions.front();
-        ReservationStation *rs = getAvailableReservationStation(instruction.op);
-        if (rs == nullptr)
-            return;
+// Blank lines and '#' comments, indented or not, are skipped by both the
+// program decoder and the streaming reader.
+static bool isBlankOrComment(const char *line, size_t length)
+{
+    size_t start = indentOf(line, length);
+    return start == length || line[start] == '#';
+}
 
-        instructions.pop();
+static size_t labelLength(const char *line, size_t length)
+{
+    if (isBlankOrComment(line, length))
+        return 0;
 
-        instructionsStatus.push_back(InstructionStatus(instruction));
-        int instructionIndex = instructionsStatus.size() - 1;
+    size_t start = indentOf(line, length);
 
-        auto &status = instructionsStatus[instructionIndex];
-        status.issueTime = cycle + 1;
+    size_t end = start;
+    while (end < length && line[end] != ' ' && line[end] != '\t' && line[end] != '\r' && line[end] != ':')
+        end++;
+    return end < length && line[end] == ':' ? end + 1 : 0;
+}
 
-        string type;
-        string destination;
-        if (instruction.op == "LW")
-        {
-            type = "load";
-            destination = instruction.rd;
-        }
-        else if (instruction.op == "SW")
-        {
-            type = "store";
-            destination = "";
-        }
-        else
-        {
-            type = "arith";
-            destination = instruction.rd;
-        }
+// Whether any line of a text trace defines a label. Only lines holding a
+// ':' are examined, so traces without one are checked at memchr speed.
+static bool definesLabels(const char *data, size_t size)
+{
+    const char *end = data + size;
+    const char *colon = static_cast<const char *>(memchr(data, ':', size));
+    while (colon != nullptr)
+    {
+        const char *line = colon;
+        while (line > data && line[-1] != '\n')
+            line--;
+        const char *newline = static_cast<const char *>(memchr(colon, '\n', end - colon));
+        const char *lineEnd = newline != nullptr ? newline : end;
+        if (labelLength(line, lineEnd - line) > 0)
+            return true;
+        if (newline == nullptr)
+            break;
+        colon = static_cast<const char *>(memchr(newline, ':', end - newline));
+    }
+    return false;
+}
 
-        rob[robTail] = {true, false, destination, 0, type, instructionIndex};
+bool decodeProgram(const char *data, size_t size, vector<Instruction> &program)
+{
+    vector<string> lines;
+    map<string, int> labels;
+    size_t pos = 0;
 
-        rs->busy = true;
-        rs->op = instruction.op;
-        rs->instructionIndex = instructionIndex;
-        rs->destRobTag = robTail;
+    while (pos < size)
+    {
+        const char *start = data + pos;
+        const char *newline = static_cast<const char *>(memchr(start, '\n', size - pos));
+        size_t length = newline ? newline - start : size - pos;
+        pos += length + (newline ? 1 : 0);
 
-        if (instruction.op == "ADD" || instruction.op == "SUB")
-        {
-            rs->remainingCycles = ADD_SUB_LATENCY;
-        }
-        else if (instruction.op == "MUL")
-        {
-            rs->remainingCycles = MUL_LATENCY;
-        }
-        else if (instruction.op == "DIV")
-        {
-            rs->remainingCycles = DIV_LATENCY;
-        }
-        else if (instruction.op == "LW" || instruction.op == "SW")
-        {
-            rs->remainingCycles = LOAD_STORE_LATENCY;
-            rs->imm = instruction.imm;
-        }
+        if (isBlankOrComment(start, length))
+            continue;
 
-        if (instruction.op == "LW")
-        {
-            registers[instruction.rd].robTag = robTail;
+        string line(start, length);
 
-            if (registers[instruction.rs1].robTag == -1)
-            {
-                rs->vj = registers[instruction.rs1].value;
-                rs->addr = to_string(stoi(instruction.imm) + rs->vj);
-            }
-            else
-            {
-                ROBEntry &entry = rob[registers[instruction.rs1].robTag];
-                rs->qj = entry.ready ? -1 : registers[instruction.rs1].robTag;
-                if (entry.ready)
-                {
-                    rs->vj = entry.value;
-                    rs->addr = to_string(stoi(instruction.imm) + rs->vj);
-                }
-            }
-        }
-        else if (instruction.op == "SW")
+        size_t label = labelLength(start, length);
+        if (label > 0)
         {
-            if (registers[instruction.rs1].robTag == -1)
-            {
-                rs->vj = registers[instruction.rs1].value;
-                int base = rs->vj;
-                int offset = stoi(instruction.imm);
-                rob[robTail].destination = to_string(base + offset);
-            }
-            else
-            {
-                ROBEntry &entry = rob[registers[instruction.rs1].robTag];
-                rs->qj = entry.ready ? -1 : registers[instruction.rs1].robTag;
-                if (entry.ready)
-                {
-                    rs->vj = entry.value;
-                    int base = rs->vj;
-                    int offset = stoi(instruction.imm);
-                    rob[robTail].destination = to_string(base + offset);
-                }
-            }
-
-            if (registers[instruction.rd].robTag == -1)
-            {
-                rs->vk = registers[instruction.rd].value;
-            }
-            else
+            string name = line.substr(line.find_first_not_of(" \t"), string::npos);
+            name.erase(name.find(':'));
+            if (!labels.emplace(name, lines.size()).second)
             {
-                ROBEntry &entry = rob[registers[instruction.rd].robTag];
-                rs->qk = entry.ready ? -1 : registers[instruction.rd].robTag;
-                if (entry.ready)
-                    rs->vk = entry.value;
+                cerr << "Duplicate label: " << name << endl;
+                return false;
             }
+            line.erase(0, label);
         }
-        else
-        {
-            registers[instruction.rd].robTag = robTail;
-
-            if (registers[instruction.rs1].robTag == -1)
-            {
-                rs->vj = registers[instruction.rs1].value;
-            }
-            else
-            {
-                ROBEntry &entry = rob[registers[instruction.rs1].robTag];
-                rs->qj = entry.ready ? -1 : registers[instruction.rs1].robTag;
-                if (entry.ready)
-                    rs->vj = entry.value;
-            }
 
-            if (registers[instruction.rs2].robTag == -1)
-            {
-                rs->vk = registers[instruction.rs2].value;
-            }
-            else
-            {
-                ROBEntry &entry = rob[registers[instruction.rs2].robTag];
-                rs->qk = entry.ready ? -1 : registers[instruction.rs2].robTag;
-                if (entry.ready)
-                    rs->vk = entry.value;
-            }
-        }
+        if (line.find_first_not_of(" \t\r") != string::npos)
+            lines.push_back(line);
+    }
 
-        robTail = (robTail + 1) % robSize;
+    // Malformed lines are reported and skipped, as in streamed traces. Labels
+    // point at line numbers, so branch targets are renumbered around them.
+    vector<int> position(lines.size() + 1);
+    program.clear();
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        position[i] = static_cast<int>(program.size());
+        Instruction instruction;
+        if (decodeInstruction(lines[i], instruction, &labels))
+            program.push_back(instruction);
     }
+    position[lines.size()] = static_cast<int>(program.size());
 
-    void executeInstructions()
+    for (Instruction &instruction : program)
     {
-        for (auto &rs : addRS)
-        {
-            if (rs.busy && rs.qj == -1 && rs.qk == -1 && rs.remainingCycles > 0)
-            {
-                rs.remainingCycles--;
+        if (isBranch(instruction.op))
+            instruction.imm = position[instruction.imm];
+    }
+    return true;
+}
 
-                if (rs.remainingCycles == 0)
-                {
-                    instructionsStatus.at(rs.instructionIndex).execCompleteTime = cycle + 1;
-                }
-            }
-        }
+bool decodeProgram(const string &source, vector<Instruction> &program)
+{
+    return decodeProgram(source.data(), source.size(), program);
+}
 
-        for (auto &rs : mulRS)
-        {
-            if (rs.busy && rs.qj == -1 && rs.qk == -1 && rs.remainingCycles > 0)
-            {
-                rs.remainingCycles--;
+class InstructionRing
+{
+private:
+    vector<Instruction> slots;
+    size_t mask;
+    alignas(64) atomic<size_t> head;
+    alignas(64) atomic<size_t> tail;
 
-                if (rs.remainingCycles == 0)
-                {
-                    instructionsStatus.at(rs.instructionIndex).execCompleteTime = cycle + 1;
-                }
-            }
-        }
+public:
+    explicit InstructionRing(size_t capacity)
+        : head(0), tail(0)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
 
-        for (auto &rs : loadStoreRS)
-        {
-            if (rs.busy && rs.qj == -1 && (rs.op != "SW" || rs.qk == -1) && rs.remainingCycles > 0)
-            {
-                if (rs.op == "SW" && rs.addr.empty() && rob[rs.destRobTag].destination != "")
-                {
-                    rs.addr = rob[rs.destRobTag].destination;
-                }
+        slots.resize(size);
+        mask = size - 1;
+    }
 
-                rs.remainingCycles--;
+    bool tryPush(const Instruction &instruction)
+    {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) == slots.size())
+            return false;
 
-                if (rs.remainingCycles == 0)
-                {
-                    instructionsStatus.at(rs.instructionIndex).execCompleteTime = cycle + 1;
-                }
-            }
-        }
+        slots[t & mask] = instruction;
+        tail.store(t + 1, memory_order_release);
+        return true;
     }
 
-    void writeResults()
+    const Instruction *front() const
     {
-        for (auto &rs : addRS)
-        {
-            if (rs.busy && rs.remainingCycles == 0)
-            {
-                int result = 0;
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire))
+            return nullptr;
 
-                if (rs.op == "ADD")
-                {
-                    result = rs.vj + rs.vk;
-                }
-                else if (rs.op == "SUB")
-                {
-                    result = rs.vj - rs.vk;
-                }
+        return &slots[h & mask];
+    }
 
-                rob[rs.destRobTag].value = result;
-                rob[rs.destRobTag].ready = true;
+    void pop()
+    {
+        head.store(head.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+};
 
-                broadcastResult(rs.destRobTag, result);
+struct TraceHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t recordCount;
+    uint64_t checksum;
+    uint32_t recordSize;
+    uint32_t reserved;
+};
 
-                auto &status = instructionsStatus.at(rs.instructionIndex);
-                status.writeResultTime = cycle + 1;
+static const char TRACE_MAGIC[4] = {'T', 'M', 'S', 'L'};
+static const uint32_t TRACE_VERSION = 1;
 
-                rs.reset();
-            }
-        }
+static_assert(sizeof(Instruction) == 8, "binary trace records must stay 8 bytes");
+static_assert(sizeof(TraceHeader) % alignof(Instruction) == 0, "records must be aligned after the header");
 
-        for (auto &rs : mulRS)
-        {
-            if (rs.busy && rs.remainingCycles == 0)
-            {
-                int result = 0;
+uint64_t traceChecksum(uint64_t hash, const void *bytes, size_t length)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(bytes);
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
 
-                if (rs.op == "MUL")
-                {
-                    result = rs.vj * rs.vk;
-                }
-                else if (rs.op == "DIV")
-                {
-                    if (rs.vk != 0)
-                    {
-                        result = rs.vj / rs.vk;
-                    }
-                    else
-                    {
-                        cerr << "Warning: Division by zero detected!" << endl;
-                        result = 0;
-                    }
-                }
+static const uint64_t TRACE_CHECKSUM_SEED = 14695981039346656037ULL;
 
-                rob[rs.destRobTag].value = result;
-                rob[rs.destRobTag].ready = true;
-                broadcastResult(rs.destRobTag, result);
+bool isValidRecord(const Instruction &instruction, uint64_t recordCount)
+{
+    if (static_cast<uint8_t>(instruction.op) > static_cast<uint8_t>(Opcode::J))
+        return false;
 
-                auto &status = instructionsStatus.at(rs.instructionIndex);
-                status.writeResultTime = cycle + 1;
+    if (isBranch(instruction.op) && (instruction.imm < 0 || static_cast<uint64_t>(instruction.imm) > recordCount))
+        return false;
 
-                rs.reset();
-            }
-        }
+    bool hasRs1 = instruction.op != Opcode::J;
+    if (hasRs1 && (instruction.rs1 < 0 || instruction.rs1 >= NUM_REGISTERS))
+        return false;
 
-        for (auto &rs : loadStoreRS)
-        {
-            if (rs.busy && rs.remainingCycles == 0)
-            {
-                if (rs.op == "LW")
-                {
-                    rob[rs.destRobTag].value = memory[rs.addr];
-                    rob[rs.destRobTag].ready = true;
-                    broadcastResult(rs.destRobTag, rob[rs.destRobTag].value);
-                }
-                else if (rs.op == "SW")
-                {
-                    rob[rs.destRobTag].value = rs.vk;
-                    rob[rs.destRobTag].ready = true;
-                }
+    bool hasRd = instruction.op != Opcode::SW && !isBranch(instruction.op);
+    bool hasRs2 = instruction.op != Opcode::LW && instruction.op != Opcode::J;
+    if (hasRd && (instruction.rd < 0 || instruction.rd >= NUM_REGISTERS))
+        return false;
+    if (hasRs2 && (instruction.rs2 < 0 || instruction.rs2 >= NUM_REGISTERS))
+        return false;
 
-                auto &status = instructionsStatus.at(rs.instructionIndex);
-                status.writeResultTime = cycle + 1;
+    return true;
+}
 
-                rs.reset();
-            }
+class BinaryTraceWriter
+{
+private:
+    FILE *output;
+    TraceHeader header;
+    bool ok;
+
+public:
+    BinaryTraceWriter() : output(nullptr), header(), ok(false) {}
+
+    ~BinaryTraceWriter()
+    {
+        close();
+    }
+
+    bool open(const string &filePath)
+    {
+        close();
+        output = fopen(filePath.c_str(), "wb");
+        if (output == nullptr)
+        {
+            cerr << "Error creating file: " << filePath << endl;
+            return false;
         }
+
+        header = {};
+        memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        header.version = TRACE_VERSION;
+        header.recordSize = sizeof(Instruction);
+        header.checksum = TRACE_CHECKSUM_SEED;
+        ok = fwrite(&header, sizeof(header), 1, output) == 1;
+        return ok;
     }
 
-    void commit()
+    bool isOpen() const
     {
-        if (!rob[robHead].busy)
-            return;
+        return output != nullptr;
+    }
 
-        ROBEntry &entry = rob[robHead];
-        if (entry.ready)
-        {
-            if (entry.type == "arith" || entry.type == "load")
-            {
-                if (registers[entry.destination].robTag == robHead)
-                {
-                    registers[entry.destination].value = entry.value;
-                    registers[entry.destination].robTag = -1;
-                }
-            }
-            else if (entry.type == "store")
+    uint64_t count() const
+    {
+        return header.recordCount;
+    }
+
+    void write(const Instruction &record)
+    {
+        header.checksum = traceChecksum(header.checksum, &record, sizeof(record));
+        header.recordCount++;
+        ok = ok && fwrite(&record, sizeof(record), 1, output) == 1;
+    }
+
+    bool close()
+    {
+        if (output == nullptr)
+            return ok;
+
+        ok = ok && fseek(output, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, output) == 1;
+        ok = (fclose(output) == 0) && ok;
+        output = nullptr;
+        return ok;
+    }
+};
+
+class TraceGenerator
+{
+private:
+    static const int FIRST_DEST = 6;
+    static const int DEST_COUNT = NUM_REGISTERS - FIRST_DEST;
+    static const int HISTORY = 64;
+
+    GeneratorConfig config;
+    uint64_t state;
+    uint64_t generated;
+    uint64_t memoryAccesses;
+    uint64_t destinationsWritten;
+    int mixTotal;
+    int distanceTotal;
+    int8_t historyRd[HISTORY];
+    uint64_t historyWrite[HISTORY];
+
+    uint64_t random()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ULL;
+    }
+
+    int uniform(int bound)
+    {
+        return static_cast<int>(random() % static_cast<uint64_t>(bound));
+    }
+
+    int8_t independentSource()
+    {
+        return static_cast<int8_t>(uniform(FIRST_DEST));
+    }
+
+    int8_t dependentSource()
+    {
+        int pick = uniform(distanceTotal);
+        int distance = 0;
+        for (const auto &entry : config.distances)
+        {
+            if (pick < entry.second)
             {
-                memory[entry.destination] = entry.value;
+                distance = min(entry.first, HISTORY - 1);
+                break;
             }
+            pick -= entry.second;
+        }
 
-            instructionsStatus[entry.instructionIndex].commitTime = cycle + 1;
+        if (distance == 0 || static_cast<uint64_t>(distance) > generated)
+            return independentSource();
 
-            rob[robHead].busy = false;
-            robHead = (robHead + 1) % robSize;
+        int slot = (generated - distance) % HISTORY;
+        if (historyRd[slot] < 0 || destinationsWritten - historyWrite[slot] > DEST_COUNT)
+            return independentSource();
+
+        return historyRd[slot];
+    }
+
+    int32_t nextAddress()
+    {
+        uint64_t access = memoryAccesses++;
+        switch (config.pattern)
+        {
+        case AddressPattern::Stride:
+            return static_cast<int32_t>(access * config.stride % config.footprint);
+        case AddressPattern::Random:
+            return uniform(config.footprint);
+        case AddressPattern::HotSet:
+            return uniform(100) < config.hotPercent ? uniform(config.hotSetSize) : uniform(config.footprint);
         }
+        return 0;
     }
 
-    void broadcastResult(int robTag, int value)
+public:
+    explicit TraceGenerator(const GeneratorConfig &config)
+        : config(config), generated(0), memoryAccesses(0), destinationsWritten(0), mixTotal(0), distanceTotal(0)
+    {
+        state = config.seed * 0x9E3779B97F4A7C15ULL + 0xD1B54A32D192ED03ULL;
+        if (state == 0)
+            state = 1;
+
+        for (int weight : config.mix)
+            mixTotal += weight;
+        for (const auto &entry : config.distances)
+            distanceTotal += entry.second;
+
+        fill(begin(historyRd), end(historyRd), -1);
+        fill(begin(historyWrite), end(historyWrite), 0);
+    }
+
+    bool next(Instruction &instruction)
     {
-        for (auto &rs : addRS)
+        if (generated == config.length)
+            return false;
+
+        int pick = uniform(mixTotal);
+        int kind = 0;
+        while (pick >= config.mix[kind])
+            pick -= config.mix[kind++];
+
+        instruction.op = static_cast<Opcode>(kind);
+        instruction.rd = -1;
+        instruction.rs1 = dependentSource();
+        instruction.rs2 = dependentSource();
+        instruction.imm = 0;
+
+        switch (instruction.op)
         {
-            if (rs.busy)
-            {
-                if (rs.qj == robTag)
-                {
-                    rs.vj = value;
-                    rs.qj = -1;
-                }
-                if (rs.qk == robTag)
-                {
-                    rs.vk = value;
-                    rs.qk = -1;
-                }
-            }
+        case Opcode::DIV:
+            instruction.rs2 = independentSource();
+            break;
+        case Opcode::LW:
+            instruction.rs1 = 0;
+            instruction.rs2 = -1;
+            instruction.imm = nextAddress();
+            break;
+        case Opcode::SW:
+            instruction.rs1 = 0;
+            instruction.imm = nextAddress();
+            break;
+        default:
+            break;
         }
 
-        for (auto &rs : mulRS)
+        int slot = generated % HISTORY;
+        historyRd[slot] = -1;
+        if (instruction.op != Opcode::SW)
         {
-            if (rs.busy)
-            {
-                if (rs.qj == robTag)
-                {
-                    rs.vj = value;
-                    rs.qj = -1;
-                }
-                if (rs.qk == robTag)
-                {
-                    rs.vk = value;
-                    rs.qk = -1;
-                }
-            }
+            instruction.rd = static_cast<int8_t>(FIRST_DEST + destinationsWritten % DEST_COUNT);
+            historyRd[slot] = instruction.rd;
+            historyWrite[slot] = ++destinationsWritten;
         }
 
-        for (auto &rs : loadStoreRS)
+        generated++;
+        return true;
+    }
+};
+
+class TraceStream
+{
+private:
+    static const size_t RELEASE_CHUNK = 16 << 20;
+    static const size_t RECORDS_PER_CHUNK = RELEASE_CHUNK / sizeof(Instruction);
+
+    InstructionRing ring;
+    const char *data;
+    size_t size;
+    thread producer;
+    atomic<bool> finished;
+    atomic<bool> stopRequested;
+
+    bool binary;
+    const Instruction *records;
+    size_t recordCount;
+    size_t cursor;
+    size_t consumed;
+    vector<Instruction> program;
+    BinaryTraceWriter tee;
+
+    void releasePages(size_t from, size_t to)
+    {
+        static const size_t pageSize = sysconf(_SC_PAGESIZE);
+        from &= ~(pageSize - 1);
+        to &= ~(pageSize - 1);
+        if (to > from)
+            madvise(const_cast<char *>(data) + from, to - from, MADV_DONTNEED);
+    }
+
+    void decodeAll()
+    {
+        size_t pos = 0;
+        size_t released = 0;
+        string line;
+
+        while (pos < size && !stopRequested.load(memory_order_relaxed))
         {
-            if (rs.busy)
+            const char *start = data + pos;
+            const char *newline = static_cast<const char *>(memchr(start, '\n', size - pos));
+            size_t length = newline ? newline - start : size - pos;
+            pos += length + (newline ? 1 : 0);
+
+            if (pos - released >= RELEASE_CHUNK)
             {
-                if (rs.qj == robTag)
-                {
-                    rs.vj = value;
-                    rs.qj = -1;
-
-                    if (rs.op == "SW" && rs.qj == -1)
-                    {
-                        int base = rs.vj;
-                        int offset = stoi(rs.imm);
-                        rob[rs.destRobTag].destination = to_string(base + offset);
-                    }
-                }
-                if (rs.qk == robTag)
-                {
-                    rs.vk = value;
-                    rs.qk = -1;
-                }
+                releasePages(released, pos);
+                released = pos;
+            }
+
+            if (isBlankOrComment(start, length))
+                continue;
+
+            line.assign(start, length);
+
+            Instruction instruction;
+            if (!decodeInstruction(line, instruction))
+                continue;
+
+            while (!ring.tryPush(instruction))
+            {
+                if (stopRequested.load(memory_order_relaxed))
+                    return;
+                this_thread::yield();
             }
         }
     }
 
-    ReservationStation *getAvailableReservationStation(const string &op)
+    bool openBinary(const string &filePath)
     {
-        if (op == "ADD" || op == "SUB")
+        TraceHeader header;
+        memcpy(&header, data, sizeof(header));
+
+        if (header.version != TRACE_VERSION || header.recordSize != sizeof(Instruction))
         {
-            for (auto &rs : addRS)
-            {
-                if (!rs.busy)
-                    return &rs;
-            }
+            cerr << "Unsupported binary trace version in " << filePath << endl;
+            return false;
         }
-        else if (op == "MUL" || op == "DIV")
+
+        if (header.recordCount > (size - sizeof(header)) / sizeof(Instruction))
         {
-            for (auto &rs : mulRS)
-            {
-                if (!rs.busy)
-                    return &rs;
-            }
+            cerr << "Truncated binary trace: " << filePath << endl;
+            return false;
         }
-        else if (op == "LW" || op == "SW")
+
+        records = reinterpret_cast<const Instruction *>(data + sizeof(header));
+        recordCount = header.recordCount;
+
+        uint64_t checksum = TRACE_CHECKSUM_SEED;
+        for (size_t first = 0; first < recordCount; first += RECORDS_PER_CHUNK)
         {
-            for (auto &rs : loadStoreRS)
+            size_t last = min(recordCount, first + RECORDS_PER_CHUNK);
+            for (size_t i = first; i < last; i++)
             {
-                if (!rs.busy)
-                    return &rs;
+                if (!isValidRecord(records[i], recordCount))
+                {
+                    cerr << "Invalid record " << i << " in binary trace: " << filePath << endl;
+                    return false;
+                }
             }
+            checksum = traceChecksum(checksum, records + first, (last - first) * sizeof(Instruction));
+            releasePages(sizeof(header) + first * sizeof(Instruction), sizeof(header) + last * sizeof(Instruction));
+        }
+
+        if (checksum != header.checksum)
+        {
+            cerr << "Checksum mismatch in binary trace: " << filePath << endl;
+            return false;
         }
 
-        return nullptr;
+        binary = true;
+        cursor = 0;
+        return true;
     }
 
-    bool checkSimulationComplete()
+    bool openProgram(const string &filePath)
     {
-        if (!instructions.empty())
+        bool ok = decodeProgram(data, size, program);
+        munmap(const_cast<char *>(data), size);
+        data = nullptr;
+        size = 0;
+
+        if (!ok)
+        {
+            cerr << "Error decoding program: " << filePath << endl;
             return false;
+        }
+
+        binary = true;
+        records = program.data();
+        recordCount = program.size();
+        cursor = 0;
+        return true;
+    }
+
+public:
+    explicit TraceStream(size_t ringCapacity)
+        : ring(ringCapacity), data(nullptr), size(0), finished(true), stopRequested(false),
+          binary(false), records(nullptr), recordCount(0), cursor(0), consumed(0) {}
+
+    ~TraceStream()
+    {
+        close();
+    }
 
-        for (const auto &rs : addRS)
+    bool open(const string &filePath)
+    {
+        close();
+
+        int fd = ::open(filePath.c_str(), O_RDONLY);
+        if (fd == -1)
         {
-            if (rs.busy)
-                return false;
+            cerr << "Error opening file: " << filePath << endl;
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) == -1)
+        {
+            cerr << "Error reading file: " << filePath << endl;
+            ::close(fd);
+            return false;
         }
-        for (const auto &rs : mulRS)
+
+        size = info.st_size;
+        if (size > 0)
         {
-            if (rs.busy)
+            void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED)
+            {
+                cerr << "Error mapping file: " << filePath << endl;
+                ::close(fd);
+                size = 0;
                 return false;
+            }
+            data = static_cast<const char *>(mapped);
+            madvise(mapped, size, MADV_SEQUENTIAL);
         }
-        for (const auto &rs : loadStoreRS)
+        ::close(fd);
+
+        if (size >= sizeof(TraceHeader) && memcmp(data, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0)
         {
-            if (rs.busy)
+            if (!openBinary(filePath))
+            {
+                close();
                 return false;
+            }
+            return true;
         }
 
-        for (const auto &entry : rob)
+        if (definesLabels(data, size))
         {
-            if (entry.busy)
+            if (!openProgram(filePath))
+            {
+                close();
                 return false;
+            }
+            return true;
         }
 
+        finished.store(false);
+        stopRequested.store(false);
+        producer = thread([this]()
+                          {
+            decodeAll();
+            finished.store(true, memory_order_release); });
         return true;
     }
 
-    void printState()
+    bool generate(const GeneratorConfig &config, const string &outputPath)
     {
-        cout << "\nReservation Station ADD/SUB:" << endl;
-        cout << "Name\tBusy\tOp\tVj\tVk\tQj\tQk\tDestROB" << endl;
-        for (const auto &rs : addRS)
-        {
-            cout << rs.name << "\t"
-                 << (rs.busy ? "Yes" : "No") << "\t"
-                 << (rs.busy ? rs.op : "-") << "\t"
-                 << rs.vj << "\t"
-                 << rs.vk << "\t"
-                 << (rs.qj != -1 ? "ROB" + to_string(rs.qj) : "-") << "\t"
-                 << (rs.qk != -1 ? "ROB" + to_string(rs.qk) : "-") << "\t"
-                 << (rs.destRobTag != -1 ? "ROB" + to_string(rs.destRobTag) : "-") << endl;
-        }
-
-        cout << "\nReservation Station MUL/DIV:" << endl;
-        cout << "Name\tBusy\tOp\tVj\tVk\tQj\tQk\tDestROB" << endl;
-        for (const auto &rs : mulRS)
-        {
-            cout << rs.name << "\t"
-                 << (rs.busy ? "Yes" : "No") << "\t"
-                 << (rs.busy ? rs.op : "-") << "\t"
-                 << rs.vj << "\t"
-                 << rs.vk << "\t"
-                 << (rs.qj != -1 ? "ROB" + to_string(rs.qj) : "-") << "\t"
-                 << (rs.qk != -1 ? "ROB" + to_string(rs.qk) : "-") << "\t"
-                 << (rs.destRobTag != -1 ? "ROB" + to_string(rs.destRobTag) : "-") << endl;
-        }
-
-        cout << "\nReservation Station LOAD/STORE:" << endl;
-        cout << "Name\tBusy\tOp\tA\tVj\tVk\tQj\tQk\tDestROB" << endl;
-        for (const auto &rs : loadStoreRS)
-        {
-            cout << rs.name << "\t"
-                 << (rs.busy ? "Yes" : "No") << "\t"
-                 << (rs.busy ? rs.op : "-") << "\t"
-                 << (!rs.addr.empty() ? rs.addr : "-") << "\t"
-                 << rs.vj << "\t"
-                 << rs.vk << "\t"
-                 << (rs.qj != -1 ? "ROB" + to_string(rs.qj) : "-") << "\t"
-                 << (rs.qk != -1 ? "ROB" + to_string(rs.qk) : "-") << "\t"
-                 << (rs.destRobTag != -1 ? "ROB" + to_string(rs.destRobTag) : "-") << endl;
-        }
-
-        cout << "\nROB Status:" << endl;
-        cout << "Entry\tBusy\tReady\tType\tDest\tValue" << endl;
-        for (int i = 0; i < robSize; i++)
+        close();
+
+        if (!outputPath.empty() && !tee.open(outputPath))
+            return false;
+
+        finished.store(false);
+        stopRequested.store(false);
+        producer = thread([this, config]()
+                          {
+            TraceGenerator generator(config);
+            Instruction instruction;
+            while (generator.next(instruction) && !stopRequested.load(memory_order_relaxed))
+            {
+                if (tee.isOpen())
+                    tee.write(instruction);
+
+                while (!ring.tryPush(instruction))
+                {
+                    if (stopRequested.load(memory_order_relaxed))
+                        break;
+                    this_thread::yield();
+                }
+            }
+            finished.store(true, memory_order_release); });
+        return true;
+    }
+
+    void attach(const Instruction *trace, size_t count)
+    {
+        close();
+        binary = true;
+        records = trace;
+        recordCount = count;
+    }
+
+    void close()
+    {
+        if (producer.joinable())
         {
-            auto &entry = rob[i];
-            cout << i << "\t"
-                 << (entry.busy ? "Yes" : "No") << "\t"
-                 << (entry.ready ? "Yes" : "No") << "\t"
-                 << (entry.busy ? entry.type : "-") << "\t"
-                 << (entry.busy ? entry.destination : "-") << "\t"
-                 << (entry.busy ? to_string(entry.value) : "-") << endl;
+            stopRequested.store(true);
+            producer.join();
+        }
+        finished.store(true);
+
+        if (tee.isOpen() && !tee.close())
+            cerr << "Error writing generated trace" << endl;
+
+        if (data != nullptr)
+        {
+            munmap(const_cast<char *>(data), size);
+            data = nullptr;
         }
+        size = 0;
+        binary = false;
+        records = nullptr;
+        recordCount = 0;
+        cursor = 0;
+        consumed = 0;
+        program.clear();
+    }
 
-        cout << "\nRegisters Status:" << endl;
-        cout << "Reg\tValue\tROB Tag" << endl;
+    bool seekable() const
+    {
+        return binary;
+    }
+
+    // Instructions in the trace, when known up front; 0 for streamed traces.
+    size_t length() const
+    {
+        return binary ? recordCount : 0;
+    }
 
-        vector<string> sortedRegs(usedRegisters.begin(), usedRegisters.end());
-        sort(sortedRegs.begin(), sortedRegs.end(), [](const string &a, const string &b)
-             { return stoi(a.substr(1)) < stoi(b.substr(1)); });
+    size_t position() const
+    {
+        return binary ? cursor : consumed;
+    }
 
-        for (const auto &regName : sortedRegs)
+    bool seek(size_t index)
+    {
+        if (binary)
         {
-            const auto &reg = registers[regName];
-            cout << regName << "\t"
-                 << reg.value << "\t"
-                 << (reg.robTag != -1 ? "ROB" + to_string(reg.robTag) : "-") << endl;
+            cursor = index;
+            return true;
         }
+
+        while (consumed < index && peek() != nullptr)
+            pop();
+        return consumed == index;
     }
 
-    void printFinalResults()
+    const Instruction *peek()
     {
-        cout << "\n=== Final Results ===" << endl;
+        if (binary)
+            return cursor < recordCount ? &records[cursor] : nullptr;
 
-        cout << "\nInstruction Timeline:" << endl;
-        cout << "Instruction\t\tIssue\tExecComp\tWriteRes\tCommit" << endl;
-        for (size_t i = 0; i < instructionsStatus.size(); i++)
+        while (true)
         {
-            const auto &instr = instructionsStatus[i].instruction;
-            cout << instr.op << " "
-                 << instr.rd << " " << instr.rs1;
-            if (!instr.rs2.empty())
-                cout << " " << instr.rs2;
-            else if (!instr.imm.empty())
-                cout << " " << instr.imm;
+            if (const Instruction *next = ring.front())
+                return next;
 
-            cout << "\t\t" << instructionsStatus[i].issueTime << "\t"
-                 << instructionsStatus[i].execCompleteTime << "\t\t"
-                 << instructionsStatus[i].writeResultTime << "\t\t"
-                 << instructionsStatus[i].commitTime << endl;
-        }
+            if (finished.load(memory_order_acquire))
+                return ring.front();
 
-        cout << "\nFinal Register Values:" << endl;
-        vector<string> sortedRegs(usedRegisters.begin(), usedRegisters.end());
-        sort(sortedRegs.begin(), sortedRegs.end(), [](const string &a, const string &b)
-             { return stoi(a.substr(1)) < stoi(b.substr(1)); });
+            this_thread::yield();
+        }
+    }
 
-        for (const auto &regName : sortedRegs)
+    void pop()
+    {
+        if (!binary)
         {
-            const auto &reg = registers[regName];
-            cout << regName << " = " << reg.value << endl;
+            ring.pop();
+            consumed++;
+            return;
         }
 
-        cout << "\nFinal Memory Contents:" << endl;
-        vector<pair<string, int>> sortedMem;
-        for (const auto &mem : memory)
+        cursor++;
+        if (data != nullptr && cursor % RECORDS_PER_CHUNK == 0)
         {
-            if (mem.second != 0)
-            {
-                sortedMem.push_back(mem);
-            }
+            size_t end = sizeof(TraceHeader) + cursor * sizeof(Instruction);
+            releasePages(end - RELEASE_CHUNK, end);
         }
+    }
+
+    bool empty()
+    {
+        return peek() == nullptr;
+    }
+};
+
+bool convertTextTrace(const string &inputPath, const string &outputPath)
+{
+    TraceStream input(4096);
+    if (!input.open(inputPath))
+        return false;
 
-        sort(sortedMem.begin(), sortedMem.end(), [](const auto &a, const auto &b)
-             { return stoi(a.first) < stoi(b.first); });
+    BinaryTraceWriter output;
+    if (!output.open(outputPath))
+        return false;
 
-        for (const auto &mem : sortedMem)
+    while (const Instruction *next = input.peek())
+    {
+        output.write(*next);
+        input.pop();
+    }
+
+    uint64_t count = output.count();
+    if (!output.close())
+    {
+        cerr << "Error writing file: " << outputPath << endl;
+        return false;
+    }
+
+    cout << "Wrote " << count << " instructions to " << outputPath << endl;
+    return true;
+}
+
+class CheckpointWriter
+{
+private:
+    vector<char> bytes;
+
+public:
+    template <typename T>
+    void put(const T &value)
+    {
+        static_assert(is_trivially_copyable<T>::value, "checkpoint fields must be trivially copyable");
+        const char *p = reinterpret_cast<const char *>(&value);
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+
+    template <typename T>
+    void putVector(const vector<T> &values)
+    {
+        static_assert(is_trivially_copyable<T>::value, "checkpoint fields must be trivially copyable");
+        put<uint64_t>(values.size());
+        const char *p = reinterpret_cast<const char *>(values.data());
+        bytes.insert(bytes.end(), p, p + values.size() * sizeof(T));
+    }
+
+    vector<char> &data()
+    {
+        return bytes;
+    }
+};
+
+class CheckpointReader
+{
+private:
+    const vector<char> &bytes;
+    size_t offset;
+    bool valid;
+
+public:
+    explicit CheckpointReader(const vector<char> &bytes)
+        : bytes(bytes), offset(0), valid(true) {}
+
+    template <typename T>
+    void get(T &value)
+    {
+        if (!valid || bytes.size() - offset < sizeof(T))
+        {
+            valid = false;
+            return;
+        }
+        memcpy(&value, bytes.data() + offset, sizeof(T));
+        offset += sizeof(T);
+    }
+
+    template <typename T>
+    void getVector(vector<T> &values)
+    {
+        uint64_t count = 0;
+        get(count);
+        if (!valid || count > (bytes.size() - offset) / sizeof(T))
         {
-            cout << "Memory[" << mem.first << "] = " << mem.second << endl;
+            valid = false;
+            return;
         }
+        values.resize(count);
+        if (count)
+            memcpy(values.data(), bytes.data() + offset, count * sizeof(T));
+        offset += count * sizeof(T);
+    }
+
+    bool ok() const
+    {
+        return valid && offset == bytes.size();
     }
 };
 
-int main()
+struct ROBEntry
+{
+    bool busy;
+    bool ready;
+    InstrType type;
+    int destination;
+    bool hasAddress;
+    int value;
+    long long instructionIndex;
+    bool storeDataReady;
+    int storeData;
+    int physical;
+    int previousPhysical;
+};
+
+enum class Unit : uint8_t
 {
-    Tomasulo simulator(3, 2, 3, 6);
+    AddSub,
+    MulDiv,
+    LoadStore
+};
 
-    string filePath;
-    cout << "Enter the file path:" << endl;
-    cin >> filePath;
-    cin.ignore();
+static const int UNIT_COUNT = 3;
+
+const char *unitName(Unit unit)
+{
+    switch (unit)
+    {
+    case Unit::AddSub:
+        return "ADD/SUB";
+    case Unit::MulDiv:
+        return "MUL/DIV";
+    case Unit::LoadStore:
+        return "LOAD/STORE";
+    }
+    return "?";
+}
 
-    if (!simulator.loadInstructions(filePath))
+Unit unitOf(Opcode op)
+{
+    switch (op)
     {
-        cerr << "Error loading instructions.";
-        return 1;
+    case Opcode::MUL:
+    case Opcode::DIV:
+        return Unit::MulDiv;
+    case Opcode::LW:
+    case Opcode::SW:
+        return Unit::LoadStore;
+    default:
+        return Unit::AddSub;
     }
+}
+
+// Functional unit pools. The ADD/SUB stations feed the adders; the MUL/DIV
+// stations feed separate multipliers and dividers, so a long unpipelined
+// divide does not block multiplies. Loads and stores keep executing in their
+// stations, where the LSQ and the cache hierarchy model the memory pipeline.
+enum class Pool : uint8_t
+{
+    Adder,
+    Multiplier,
+    Divider,
+    None
+};
 
-    simulator.setRegister("R0", 5);   
-    simulator.setRegister("R1", 3);   
-    simulator.setRegister("R2", 2);   
-    simulator.setRegister("R3", 3);   
-    simulator.setRegister("R4", 2);  
-    simulator.setRegister("R5", 5); 
-    
-    simulator.setMemory("105", 10); 
-    simulator.setMemory("203", 0);  
+static const int POOL_COUNT = 3;
 
-    simulator.run();
+const char *poolName(int pool)
+{
+    static const char *const NAMES[POOL_COUNT] = {"ADD/SUB", "MUL", "DIV"};
+    return NAMES[pool];
+}
+
+Pool poolOf(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::ADD:
+    case Opcode::SUB:
+    case Opcode::BEQ:
+    case Opcode::BNE:
+        return Pool::Adder;
+    case Opcode::MUL:
+        return Pool::Multiplier;
+    case Opcode::DIV:
+        return Pool::Divider;
+    default:
+        return Pool::None;
+    }
+}
+
+class StationFile
+{
+private:
+    static const char *const PREFIXES[UNIT_COUNT];
+
+    vector<uint64_t> busyMask;
+    vector<uint64_t> readyMask;
+    vector<uint64_t> doneMask;
+    int unitBegin[UNIT_COUNT + 1];
 
-    return 0;
-}
\ No newline at end of file
+    static void setBit(vector<uint64_t> &mask, int id)
+    {
+        mask[id >> 6] |= 1ULL << (id & 63);
+    }
+
+    static void clearBit(vector<uint64_t> &mask, int id)
+    {
+        mask[id >> 6] &= ~(1ULL << (id & 63));
+    }
+
+    static bool testBit(const vector<uint64_t> &mask, int id)
+    {
+        return (mask[id >> 6] >> (id & 63)) & 1;
+    }
+
+    template <typename Word>
+    int countBits(Unit unit, Word word) const
+    {
+        int begin = unitBegin[static_cast<int>(unit)];
+        int end = unitBegin[static_cast<int>(unit) + 1];
+        int total = 0;
+        for (int w = begin >> 6; w < (end + 63) >> 6; w++)
+        {
+            uint64_t bits = word(w);
+            if (w == begin >> 6)
+                bits &= ~0ULL << (begin & 63);
+            if (w == end >> 6)
+                bits &= (1ULL << (end & 63)) - 1;
+            total += __builtin_popcountll(bits);
+        }
+        return total;
+    }
+
+    template <typename Word, typename Visit>
+    void scan(Word word, Visit visit) const
+    {
+        int end = count();
+        int position = 0;
+        while (position < end)
+        {
+            int w = position >> 6;
+            uint64_t bits = word(w) & (~0ULL << (position & 63));
+            if (bits == 0)
+            {
+                position = (w + 1) << 6;
+                continue;
+            }
+
+            int id = (w << 6) + __builtin_ctzll(bits);
+            if (id >= end)
+                break;
+            visit(id);
+            position = id + 1;
+        }
+    }
+
+public:
+    vector<Opcode> op;
+    vector<int> qj, qk;
+    vector<int> vj, vk;
+    vector<int> destRobTag;
+    vector<int> addr;
+    vector<int> imm;
+    vector<long long> instructionIndex;
+    vector<int> remainingCycles;
+    vector<int> forwardedValue;
+    vector<uint8_t> hasAddress;
+    vector<uint8_t> started;
+    vector<uint8_t> forwarded;
+
+    StationFile(int addCount, int mulCount, int loadStoreCount)
+    {
+        unitBegin[0] = 0;
+        unitBegin[1] = addCount;
+        unitBegin[2] = addCount + mulCount;
+        unitBegin[3] = addCount + mulCount + loadStoreCount;
+
+        int total = count();
+        size_t words = (total + 63) / 64;
+        busyMask.assign(words, 0);
+        readyMask.assign(words, 0);
+        doneMask.assign(words, 0);
+
+        op.assign(total, Opcode::ADD);
+        qj.assign(total, -1);
+        qk.assign(total, -1);
+        vj.assign(total, 0);
+        vk.assign(total, 0);
+        destRobTag.assign(total, -1);
+        addr.assign(total, 0);
+        imm.assign(total, 0);
+        instructionIndex.assign(total, -1);
+        remainingCycles.assign(total, -1);
+        forwardedValue.assign(total, 0);
+        hasAddress.assign(total, 0);
+        started.assign(total, 0);
+        forwarded.assign(total, 0);
+    }
+
+    int count() const
+    {
+        return unitBegin[UNIT_COUNT];
+    }
+
+    int begin(Unit unit) const
+    {
+        return unitBegin[static_cast<int>(unit)];
+    }
+
+    int end(Unit unit) const
+    {
+        return unitBegin[static_cast<int>(unit) + 1];
+    }
+
+    Unit unitOfStation(int id) const
+    {
+        return id < unitBegin[1] ? Unit::AddSub : id < unitBegin[2] ? Unit::MulDiv : Unit::LoadStore;
+    }
+
+    string name(int id) const
+    {
+        Unit unit = unitOfStation(id);
+        return PREFIXES[static_cast<int>(unit)] + to_string(id - begin(unit) + 1);
+    }
+
+    bool busy(int id) const
+    {
+        return testBit(busyMask, id);
+    }
+
+    bool done(int id) const
+    {
+        return testBit(doneMask, id);
+    }
+
+    bool operandsReady(int id) const
+    {
+        return qj[id] == -1 && (op[id] == Opcode::LW || qk[id] == -1);
+    }
+
+    void allocate(int id)
+    {
+        setBit(busyMask, id);
+    }
+
+    void updateReady(int id)
+    {
+        if (busy(id) && operandsReady(id))
+            setBit(readyMask, id);
+    }
+
+    void markDone(int id)
+    {
+        setBit(doneMask, id);
+    }
+
+    void reset(int id)
+    {
+        clearBit(busyMask, id);
+        clearBit(readyMask, id);
+        clearBit(doneMask, id);
+        qj[id] = qk[id] = -1;
+        vj[id] = vk[id] = 0;
+        destRobTag[id] = -1;
+        addr[id] = 0;
+        hasAddress[id] = 0;
+        imm[id] = 0;
+        instructionIndex[id] = -1;
+        remainingCycles[id] = -1;
+        started[id] = 0;
+        forwarded[id] = 0;
+        forwardedValue[id] = 0;
+    }
+
+    int firstFree(Unit unit) const
+    {
+        int begin = this->begin(unit);
+        int end = this->end(unit);
+        for (int w = begin >> 6; w < (end + 63) >> 6; w++)
+        {
+            uint64_t available = ~busyMask[w];
+            if (w == begin >> 6)
+                available &= ~0ULL << (begin & 63);
+            if (available != 0)
+            {
+                int id = (w << 6) + __builtin_ctzll(available);
+                return id < end ? id : -1;
+            }
+        }
+        return -1;
+    }
+
+    bool anyBusy() const
+    {
+        for (uint64_t word : busyMask)
+        {
+            if (word != 0)
+                return true;
+        }
+        return false;
+    }
+
+    int busyCount(Unit unit) const
+    {
+        return countBits(unit, [this](int w)
+                         { return busyMask[w]; });
+    }
+
+    int waitingCount(Unit unit) const
+    {
+        return countBits(unit, [this](int w)
+                         { return busyMask[w] & ~readyMask[w]; });
+    }
+
+    template <typename Visit>
+    void forEachBusy(Visit visit) const
+    {
+        scan([this](int w)
+             { return busyMask[w]; }, visit);
+    }
+
+    template <typename Visit>
+    void forEachExecuting(Visit visit) const
+    {
+        scan([this](int w)
+             { return readyMask[w] & ~doneMask[w]; }, visit);
+    }
+
+    template <typename Visit>
+    void forEachDone(Visit visit) const
+    {
+        scan([this](int w)
+             { return doneMask[w]; }, visit);
+    }
+};
+
+const char *const StationFile::PREFIXES[UNIT_COUNT] = {"ADD", "MUL", "LOAD"};
+
+struct Register
+{
+    int robTag;
+    int value;
+
+    Register() : robTag(-1), value(0) {}
+};
+
+// R10K-style renaming: the map table points each architectural register at a
+// physical register, and a register returns to the free list when the next
+// writer of the same architectural register commits (or when its own writer
+// is squashed).
+class PhysicalRegisterFile
+{
+private:
+    vector<int> mapTable;
+    vector<int> values;
+    vector<uint8_t> ready;
+    vector<int> producers;
+    vector<int> freeList;
+    int freeHead;
+    int freeCount;
+
+    void release(int physical)
+    {
+        freeList[(freeHead + freeCount) % freeList.size()] = physical;
+        freeCount++;
+    }
+
+public:
+    explicit PhysicalRegisterFile(int size)
+        : mapTable(NUM_REGISTERS), values(size, 0), ready(size, true),
+          producers(size, -1), freeList(size), freeHead(0), freeCount(0) {}
+
+    int size() const
+    {
+        return static_cast<int>(values.size());
+    }
+
+    int inUse() const
+    {
+        return size() - freeCount;
+    }
+
+    bool hasFree() const
+    {
+        return freeCount > 0;
+    }
+
+    void reset(const vector<Register> &registers)
+    {
+        freeHead = freeCount = 0;
+        for (int physical = 0; physical < size(); physical++)
+        {
+            ready[physical] = true;
+            producers[physical] = -1;
+            if (physical < NUM_REGISTERS)
+            {
+                mapTable[physical] = physical;
+                values[physical] = registers[physical].value;
+            }
+            else
+            {
+                values[physical] = 0;
+                release(physical);
+            }
+        }
+    }
+
+    int lookup(int reg) const
+    {
+        return mapTable[reg];
+    }
+
+    bool isReady(int physical) const
+    {
+        return ready[physical] != 0;
+    }
+
+    int value(int physical) const
+    {
+        return values[physical];
+    }
+
+    int producer(int physical) const
+    {
+        return producers[physical];
+    }
+
+    int allocate(int reg, int robTag, int &previous)
+    {
+        int physical = freeList[freeHead];
+        freeHead = (freeHead + 1) % freeList.size();
+        freeCount--;
+
+        previous = mapTable[reg];
+        mapTable[reg] = physical;
+        ready[physical] = false;
+        producers[physical] = robTag;
+        return physical;
+    }
+
+    void write(int physical, int value)
+    {
+        values[physical] = value;
+        ready[physical] = true;
+        producers[physical] = -1;
+    }
+
+    void retire(int previous)
+    {
+        release(previous);
+    }
+
+    // Squashed writers must be undone youngest first so the map table ends up
+    // pointing at the mapping that was current before the oldest of them.
+    void undo(int reg, int physical, int previous)
+    {
+        mapTable[reg] = previous;
+        ready[physical] = true;
+        producers[physical] = -1;
+        release(physical);
+    }
+
+    void save(CheckpointWriter &writer) const
+    {
+        writer.putVector(mapTable);
+        writer.putVector(values);
+        writer.putVector(ready);
+        writer.putVector(producers);
+        writer.putVector(freeList);
+        writer.put(freeHead);
+        writer.put(freeCount);
+    }
+
+    bool load(CheckpointReader &reader)
+    {
+        reader.getVector(mapTable);
+        reader.getVector(values);
+        reader.getVector(ready);
+        reader.getVector(producers);
+        reader.getVector(freeList);
+        reader.get(freeHead);
+        reader.get(freeCount);
+
+        size_t count = values.size();
+        if (mapTable.size() != NUM_REGISTERS || ready.size() != count || producers.size() != count ||
+            freeList.size() != count || freeHead < 0 || freeCount < 0)
+            return false;
+        if (count == 0)
+            return true;
+
+        auto inRange = [this](int physical)
+        { return physical >= 0 && physical < size(); };
+        return freeHead < size() && freeCount <= size() && all_of(mapTable.begin(), mapTable.end(), inRange) &&
+               all_of(freeList.begin(), freeList.end(), inRange);
+    }
+};
+
+struct UnitOperation
+{
+    Opcode op;
+    int vj, vk;
+    int destRobTag;
+    long long instructionIndex;
+    int remainingCycles;
+};
+
+// Operations dispatched to a pool count down here, independently of the
+// station they came from; a finished operation (remainingCycles == 0) waits
+// for the CDB without holding its unit.
+class FunctionalUnitPool
+{
+private:
+    vector<long long> nextAccept;
+    int latency;
+    int occupancy;
+
+public:
+    vector<UnitOperation> operations;
+    FunctionalUnitStats stats;
+
+    FunctionalUnitPool(const FunctionalUnitConfig &config, int latency)
+        : nextAccept(config.count, 0), latency(latency), occupancy(config.pipelined ? config.interval : latency) {}
+
+    bool enabled() const
+    {
+        return !nextAccept.empty();
+    }
+
+    int count() const
+    {
+        return static_cast<int>(nextAccept.size());
+    }
+
+    int operationLatency() const
+    {
+        return latency;
+    }
+
+    int cyclesPerOperation() const
+    {
+        return occupancy;
+    }
+
+    int freeUnit(long long cycle) const
+    {
+        for (int unit = 0; unit < count(); unit++)
+        {
+            if (nextAccept[unit] <= cycle)
+                return unit;
+        }
+        return -1;
+    }
+
+    long long nextFree() const
+    {
+        return *min_element(nextAccept.begin(), nextAccept.end());
+    }
+
+    void dispatch(int unit, long long cycle, const UnitOperation &operation)
+    {
+        nextAccept[unit] = cycle + occupancy;
+        operations.push_back(operation);
+        stats.dispatched++;
+        stats.busyCycles += occupancy;
+    }
+
+    void squashYoungerThan(long long instructionIndex)
+    {
+        operations.erase(remove_if(operations.begin(), operations.end(), [instructionIndex](const UnitOperation &operation)
+                                   { return operation.instructionIndex > instructionIndex; }),
+                         operations.end());
+    }
+
+    void reset()
+    {
+        nextAccept.assign(nextAccept.size(), 0);
+        operations.clear();
+    }
+
+    void save(CheckpointWriter &writer) const
+    {
+        writer.putVector(nextAccept);
+        writer.putVector(operations);
+        writer.put(stats);
+    }
+
+    void load(CheckpointReader &reader)
+    {
+        reader.getVector(nextAccept);
+        reader.getVector(operations);
+        reader.get(stats);
+    }
+};
+
+class PagedMemory
+{
+private:
+    static const int PAGE_BITS = 10;
+    static const int PAGE_SIZE = 1 << PAGE_BITS;
+    static const int PAGES_PER_CHUNK = 64;
+
+    struct Page
+    {
+        int32_t words[PAGE_SIZE];
+    };
+
+    // Sorted by page number. The first chunk and the directory are reserved
+    // up front, so a footprint of up to PAGES_PER_CHUNK pages (256 KB)
+    // touches new pages without allocating.
+    vector<pair<int, Page *>> pages;
+    vector<unique_ptr<Page[]>> arena;
+    int arenaUsed;
+    int lastPageNumber;
+    Page *lastPage;
+
+    static int pageNumberOf(int address)
+    {
+        return address >> PAGE_BITS;
+    }
+
+    static int offsetOf(int address)
+    {
+        return address & (PAGE_SIZE - 1);
+    }
+
+    Page *findPage(int pageNumber)
+    {
+        if (lastPage != nullptr && lastPageNumber == pageNumber)
+            return lastPage;
+
+        auto it = lower_bound(pages.begin(), pages.end(), pageNumber, [](const pair<int, Page *> &entry, int number)
+                              { return entry.first < number; });
+        if (it == pages.end() || it->first != pageNumber)
+            return nullptr;
+
+        lastPageNumber = pageNumber;
+        lastPage = it->second;
+        return lastPage;
+    }
+
+    void reserve()
+    {
+        pages.reserve(PAGES_PER_CHUNK);
+        arena.reserve(1);
+        arena.emplace_back(new Page[PAGES_PER_CHUNK]());
+        arenaUsed = 0;
+    }
+
+    Page *allocatePage(int pageNumber)
+    {
+        if (arena.empty() || arenaUsed == PAGES_PER_CHUNK)
+        {
+            arena.emplace_back(new Page[PAGES_PER_CHUNK]());
+            arenaUsed = 0;
+        }
+
+        Page *page = &arena.back()[arenaUsed++];
+        auto it = lower_bound(pages.begin(), pages.end(), pageNumber, [](const pair<int, Page *> &entry, int number)
+                              { return entry.first < number; });
+        pages.insert(it, {pageNumber, page});
+        lastPageNumber = pageNumber;
+        lastPage = page;
+        return page;
+    }
+
+public:
+    PagedMemory()
+        : arenaUsed(0), lastPageNumber(0), lastPage(nullptr)
+    {
+        reserve();
+    }
+
+    void clear()
+    {
+        pages.clear();
+        arena.clear();
+        reserve();
+        lastPage = nullptr;
+    }
+
+    int read(int address)
+    {
+        Page *page = findPage(pageNumberOf(address));
+        return page != nullptr ? page->words[offsetOf(address)] : 0;
+    }
+
+    void write(int address, int value)
+    {
+        int pageNumber = pageNumberOf(address);
+        Page *page = findPage(pageNumber);
+        if (page == nullptr)
+            page = allocatePage(pageNumber);
+
+        page->words[offsetOf(address)] = value;
+    }
+
+    template <typename Visitor>
+    void forEachNonZero(Visitor visit) const
+    {
+        for (const auto &entry : pages)
+        {
+            int base = entry.first * PAGE_SIZE;
+            for (int i = 0; i < PAGE_SIZE; i++)
+            {
+                if (entry.second->words[i] != 0)
+                    visit(base + i, entry.second->words[i]);
+            }
+        }
+    }
+};
+
+struct StationSnapshot
+{
+    Opcode op;
+    bool busy;
+    bool hasAddress;
+    int32_t vj, vk, qj, qk;
+    int32_t destRobTag;
+    int32_t addr;
+    int32_t remainingCycles;
+};
+
+struct RobSnapshot
+{
+    bool busy;
+    bool ready;
+    bool hasAddress;
+    InstrType type;
+    int32_t destination;
+    int32_t value;
+};
+
+class StateTraceWriter
+{
+private:
+    struct Batch
+    {
+        vector<long long> cycles;
+        vector<uint32_t> usedMasks;
+        vector<StationSnapshot> stations;
+        vector<RobSnapshot> robEntries;
+        vector<Register> registers;
+
+        void clear()
+        {
+            cycles.clear();
+            usedMasks.clear();
+            stations.clear();
+            robEntries.clear();
+            registers.clear();
+        }
+    };
+
+    static const size_t BATCH_CYCLES = 256;
+
+    FILE *file;
+    vector<string> stationNames;
+    size_t robSize;
+    Batch batches[2];
+    Batch *filling;
+    Batch *writing;
+
+    thread writer;
+    mutex lock;
+    condition_variable batchReady;
+    condition_variable batchWritten;
+    bool hasPending;
+    bool stopping;
+
+    static string tagText(int tag)
+    {
+        return tag == -1 ? "" : to_string(tag);
+    }
+
+    void writeBatch(const Batch &batch)
+    {
+        size_t stationCount = stationNames.size();
+        for (size_t c = 0; c < batch.cycles.size(); c++)
+        {
+            long long cycle = batch.cycles[c];
+
+            for (size_t i = 0; i < stationCount; i++)
+            {
+                const StationSnapshot &rs = batch.stations[c * stationCount + i];
+                if (!rs.busy)
+                {
+                    fprintf(file, "%lld,RS,%s,0,,,,,,,,,,\n", cycle, stationNames[i].c_str());
+                    continue;
+                }
+                fprintf(file, "%lld,RS,%s,1,%s,%d,%d,%s,%s,%d,%s,,,%d\n", cycle, stationNames[i].c_str(),
+                        opcodeName(rs.op), rs.vj, rs.vk, tagText(rs.qj).c_str(), tagText(rs.qk).c_str(),
+                        rs.destRobTag, rs.hasAddress ? to_string(rs.addr).c_str() : "", rs.remainingCycles);
+            }
+
+            for (size_t i = 0; i < robSize; i++)
+            {
+                const RobSnapshot &entry = batch.robEntries[c * robSize + i];
+                if (!entry.busy)
+                {
+                    fprintf(file, "%lld,ROB,%zu,0,,,,,,,,,,\n", cycle, i);
+                    continue;
+                }
+
+                string destination;
+                if (entry.type != InstrType::Store)
+                    destination = registerName(entry.destination);
+                else if (entry.hasAddress)
+                    destination = to_string(entry.destination);
+
+                fprintf(file, "%lld,ROB,%zu,1,%s,,,,,,%s,%d,%d,\n", cycle, i, instrTypeName(entry.type),
+                        destination.c_str(), entry.value, entry.ready ? 1 : 0);
+            }
+
+            uint32_t used = batch.usedMasks[c];
+            for (int r = 0; r < NUM_REGISTERS; r++)
+            {
+                if ((used >> r & 1) == 0)
+                    continue;
+
+                const Register &reg = batch.registers[c * NUM_REGISTERS + r];
+                fprintf(file, "%lld,REG,R%d,,,,,,,%s,,%d,,\n", cycle, r, tagText(reg.robTag).c_str(), reg.value);
+            }
+        }
+    }
+
+    void writerLoop()
+    {
+        unique_lock<mutex> guard(lock);
+        while (true)
+        {
+            batchReady.wait(guard, [this]()
+                            { return hasPending || stopping; });
+            if (!hasPending)
+                break;
+
+            guard.unlock();
+            writeBatch(*writing);
+            guard.lock();
+
+            hasPending = false;
+            batchWritten.notify_one();
+        }
+    }
+
+    void handOff()
+    {
+        {
+            unique_lock<mutex> guard(lock);
+            batchWritten.wait(guard, [this]()
+                              { return !hasPending; });
+            swap(filling, writing);
+            hasPending = true;
+        }
+        batchReady.notify_one();
+        filling->clear();
+    }
+
+public:
+    StateTraceWriter()
+        : file(nullptr), robSize(0), filling(&batches[0]), writing(&batches[1]), hasPending(false), stopping(false) {}
+
+    ~StateTraceWriter()
+    {
+        close();
+    }
+
+    bool isOpen() const
+    {
+        return file != nullptr;
+    }
+
+    bool open(const string &filePath, const vector<string> &names, size_t entries)
+    {
+        close();
+
+        file = fopen(filePath.c_str(), "w");
+        if (file == nullptr)
+        {
+            cerr << "Error creating file: " << filePath << endl;
+            return false;
+        }
+
+        stationNames = names;
+        robSize = entries;
+        for (Batch &batch : batches)
+        {
+            batch.clear();
+            batch.cycles.reserve(BATCH_CYCLES);
+            batch.usedMasks.reserve(BATCH_CYCLES);
+            batch.stations.reserve(BATCH_CYCLES * stationNames.size());
+            batch.robEntries.reserve(BATCH_CYCLES * robSize);
+            batch.registers.reserve(BATCH_CYCLES * NUM_REGISTERS);
+        }
+
+        fputs("cycle,kind,id,busy,op,vj,vk,qj,qk,tag,dest,value,ready,remaining\n", file);
+
+        hasPending = false;
+        stopping = false;
+        writer = thread(&StateTraceWriter::writerLoop, this);
+        return true;
+    }
+
+    void record(long long cycle, const StationFile &stations, const vector<ROBEntry> &rob,
+                const vector<Register> &registers, const vector<bool> &usedRegisters)
+    {
+        filling->cycles.push_back(cycle);
+
+        for (int id = 0; id < stations.count(); id++)
+        {
+            filling->stations.push_back({stations.op[id], stations.busy(id), stations.hasAddress[id] != 0, stations.vj[id], stations.vk[id],
+                                         stations.qj[id], stations.qk[id], stations.destRobTag[id], stations.addr[id],
+                                         stations.remainingCycles[id]});
+        }
+
+        for (const ROBEntry &entry : rob)
+        {
+            filling->robEntries.push_back({entry.busy, entry.ready, entry.hasAddress, entry.type,
+                                           entry.destination, entry.value});
+        }
+
+        uint32_t used = 0;
+        for (int r = 0; r < NUM_REGISTERS; r++)
+        {
+            if (usedRegisters[r])
+                used |= 1u << r;
+        }
+        filling->usedMasks.push_back(used);
+        filling->registers.insert(filling->registers.end(), registers.begin(), registers.end());
+
+        if (filling->cycles.size() == BATCH_CYCLES)
+            handOff();
+    }
+
+    void close()
+    {
+        if (file == nullptr)
+            return;
+
+        if (!filling->cycles.empty())
+            handOff();
+
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        batchReady.notify_one();
+        writer.join();
+
+        fclose(file);
+        file = nullptr;
+    }
+};
+
+struct TimelineFileHeader
+{
+    char magic[4];
+    uint32_t version;
+};
+
+static const char TIMELINE_MAGIC[4] = {'T', 'M', 'T', 'L'};
+static const uint32_t TIMELINE_VERSION = 1;
+
+// Instructions, then issue (against the previous entry's issue), execution
+// complete (against issue), write result (against execution complete) and
+// commit (against write result).
+static const int TIMELINE_COLUMNS = 5;
+
+struct TimelineBlockHeader
+{
+    uint32_t count; // 0 marks the end of the file; firstEntry is then the total
+    uint32_t columnBytes[TIMELINE_COLUMNS];
+    int64_t firstEntry;
+    int64_t firstCommit;
+    int64_t lastCommit;
+};
+
+static_assert(sizeof(TimelineBlockHeader) == 48, "timeline block headers must stay unpadded");
+
+static uint8_t *putVarint(uint8_t *out, int64_t value)
+{
+    uint64_t zigzag = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    while (zigzag >= 0x80)
+    {
+        *out++ = static_cast<uint8_t>(zigzag | 0x80);
+        zigzag >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(zigzag);
+    return out;
+}
+
+static const uint8_t *getVarint(const uint8_t *in, const uint8_t *end, int64_t &value)
+{
+    uint64_t zigzag = 0;
+    for (int shift = 0; in != end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *in++;
+        zigzag |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            value = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+            return in;
+        }
+    }
+    return nullptr;
+}
+
+// Streams committed timeline entries to a columnar file in blocks. The
+// simulator fills one block while a background thread encodes and writes the
+// other, the same double buffering as StateTraceWriter. The cycle columns
+// are zigzag varints of the deltas listed above, usually one byte each.
+class TimelineWriter
+{
+private:
+    static const size_t BLOCK_ENTRIES = 4096;
+    static const size_t MAX_VARINT_BYTES = 10;
+
+    FILE *file;
+    string filePath;
+    vector<InstructionStatus> blocks[2];
+    vector<InstructionStatus> *filling;
+    vector<InstructionStatus> *writing;
+    vector<uint8_t> columns[TIMELINE_COLUMNS];
+    long long appended;
+    long long nextEntry; // written by the writer thread only
+    bool failed;
+
+    thread writer;
+    mutex lock;
+    condition_variable batchReady;
+    condition_variable batchWritten;
+    bool hasPending;
+    bool stopping;
+
+    void writeBlock(const vector<InstructionStatus> &entries)
+    {
+        TimelineBlockHeader block = {};
+        block.count = static_cast<uint32_t>(entries.size());
+        block.firstEntry = nextEntry;
+        block.firstCommit = entries.front().commitTime;
+        block.lastCommit = entries.back().commitTime;
+
+        uint8_t *out[TIMELINE_COLUMNS];
+        for (int c = 0; c < TIMELINE_COLUMNS; c++)
+            out[c] = columns[c].data();
+
+        int64_t previousIssue = 0;
+        for (const InstructionStatus &status : entries)
+        {
+            memcpy(out[0], &status.instruction, sizeof(Instruction));
+            out[0] += sizeof(Instruction);
+            out[1] = putVarint(out[1], status.issueTime - previousIssue);
+            out[2] = putVarint(out[2], status.execCompleteTime - status.issueTime);
+            out[3] = putVarint(out[3], status.writeResultTime - status.execCompleteTime);
+            out[4] = putVarint(out[4], status.commitTime - status.writeResultTime);
+            previousIssue = status.issueTime;
+        }
+
+        for (int c = 0; c < TIMELINE_COLUMNS; c++)
+            block.columnBytes[c] = static_cast<uint32_t>(out[c] - columns[c].data());
+
+        bool ok = fwrite(&block, sizeof(block), 1, file) == 1;
+        for (int c = 0; c < TIMELINE_COLUMNS && ok; c++)
+            ok = fwrite(columns[c].data(), 1, block.columnBytes[c], file) == block.columnBytes[c];
+        failed = failed || !ok;
+        nextEntry += block.count;
+    }
+
+    void writerLoop()
+    {
+        unique_lock<mutex> guard(lock);
+        while (true)
+        {
+            batchReady.wait(guard, [this]()
+                            { return hasPending || stopping; });
+            if (!hasPending)
+                break;
+
+            guard.unlock();
+            writeBlock(*writing);
+            guard.lock();
+
+            hasPending = false;
+            batchWritten.notify_one();
+        }
+    }
+
+    void handOff()
+    {
+        {
+            unique_lock<mutex> guard(lock);
+            batchWritten.wait(guard, [this]()
+                              { return !hasPending; });
+            swap(filling, writing);
+            hasPending = true;
+        }
+        batchReady.notify_one();
+        filling->clear();
+    }
+
+public:
+    TimelineWriter()
+        : file(nullptr), filling(&blocks[0]), writing(&blocks[1]), appended(0), nextEntry(0), failed(false),
+          hasPending(false), stopping(false) {}
+
+    ~TimelineWriter()
+    {
+        close();
+    }
+
+    bool isOpen() const
+    {
+        return file != nullptr;
+    }
+
+    const string &path() const
+    {
+        return filePath;
+    }
+
+    long long count() const
+    {
+        return appended;
+    }
+
+    bool open(const string &path)
+    {
+        close();
+
+        file = fopen(path.c_str(), "wb");
+        if (file == nullptr)
+        {
+            cerr << "Error creating file: " << path << endl;
+            return false;
+        }
+
+        filePath = path;
+        for (vector<InstructionStatus> &block : blocks)
+        {
+            block.clear();
+            block.reserve(BLOCK_ENTRIES);
+        }
+        columns[0].resize(BLOCK_ENTRIES * sizeof(Instruction));
+        for (int c = 1; c < TIMELINE_COLUMNS; c++)
+            columns[c].resize(BLOCK_ENTRIES * MAX_VARINT_BYTES);
+
+        TimelineFileHeader header;
+        memcpy(header.magic, TIMELINE_MAGIC, sizeof(TIMELINE_MAGIC));
+        header.version = TIMELINE_VERSION;
+        failed = fwrite(&header, sizeof(header), 1, file) != 1;
+
+        appended = 0;
+        nextEntry = 0;
+        hasPending = false;
+        stopping = false;
+        writer = thread(&TimelineWriter::writerLoop, this);
+        return true;
+    }
+
+    void append(const InstructionStatus &status)
+    {
+        filling->push_back(status);
+        appended++;
+        if (filling->size() == BLOCK_ENTRIES)
+            handOff();
+    }
+
+    bool close()
+    {
+        if (file == nullptr)
+            return true;
+
+        if (!filling->empty())
+            handOff();
+
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        batchReady.notify_one();
+        writer.join();
+
+        TimelineBlockHeader end = {};
+        end.firstEntry = nextEntry;
+        bool ok = !failed && fwrite(&end, sizeof(end), 1, file) == 1;
+        ok = (fclose(file) == 0) && ok;
+        file = nullptr;
+        if (!ok)
+            cerr << "Error writing timeline file: " << filePath << endl;
+        return ok;
+    }
+};
+
+class TimelineReader
+{
+private:
+    FILE *file;
+    string filePath;
+    vector<uint8_t> payload;
+
+    bool corrupt()
+    {
+        cerr << "Corrupt timeline file: " << filePath << endl;
+        return false;
+    }
+
+public:
+    TimelineReader() : file(nullptr) {}
+
+    ~TimelineReader()
+    {
+        if (file != nullptr)
+            fclose(file);
+    }
+
+    bool open(const string &path)
+    {
+        filePath = path;
+        file = fopen(path.c_str(), "rb");
+        if (file == nullptr)
+        {
+            cerr << "Error opening file: " << path << endl;
+            return false;
+        }
+
+        TimelineFileHeader header;
+        if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TIMELINE_MAGIC, sizeof(TIMELINE_MAGIC)) != 0)
+        {
+            cerr << "Not a timeline file: " << path << endl;
+            return false;
+        }
+        if (header.version != TIMELINE_VERSION)
+        {
+            cerr << "Unsupported timeline version in " << path << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Reads the next block header. The end marker comes back as a block with
+    // no entries; a file that stops before it was not closed properly.
+    bool next(TimelineBlockHeader &block)
+    {
+        if (fread(&block, sizeof(block), 1, file) != 1)
+        {
+            cerr << "Truncated timeline file: " << filePath << endl;
+            return false;
+        }
+        if (block.columnBytes[0] != block.count * sizeof(Instruction))
+            return corrupt();
+        return true;
+    }
+
+    bool skip(const TimelineBlockHeader &block)
+    {
+        long bytes = 0;
+        for (int c = 0; c < TIMELINE_COLUMNS; c++)
+            bytes += block.columnBytes[c];
+        return fseek(file, bytes, SEEK_CUR) == 0 || corrupt();
+    }
+
+    bool decode(const TimelineBlockHeader &block, vector<InstructionStatus> &entries)
+    {
+        size_t offsets[TIMELINE_COLUMNS + 1] = {};
+        for (int c = 0; c < TIMELINE_COLUMNS; c++)
+            offsets[c + 1] = offsets[c] + block.columnBytes[c];
+
+        payload.resize(offsets[TIMELINE_COLUMNS]);
+        if (fread(payload.data(), 1, payload.size(), file) != payload.size())
+        {
+            cerr << "Truncated timeline file: " << filePath << endl;
+            return false;
+        }
+
+        const uint8_t *in[TIMELINE_COLUMNS];
+        const uint8_t *end[TIMELINE_COLUMNS];
+        for (int c = 0; c < TIMELINE_COLUMNS; c++)
+        {
+            in[c] = payload.data() + offsets[c];
+            end[c] = payload.data() + offsets[c + 1];
+        }
+
+        entries.resize(block.count);
+        int64_t issue = 0;
+        for (InstructionStatus &status : entries)
+        {
+            int64_t deltas[TIMELINE_COLUMNS];
+            memcpy(&status.instruction, in[0], sizeof(Instruction));
+            in[0] += sizeof(Instruction);
+            if (static_cast<uint8_t>(status.instruction.op) > static_cast<uint8_t>(Opcode::J))
+                return corrupt();
+
+            for (int c = 1; c < TIMELINE_COLUMNS; c++)
+            {
+                in[c] = getVarint(in[c], end[c], deltas[c]);
+                if (in[c] == nullptr)
+                    return corrupt();
+            }
+
+            issue += deltas[1];
+            status.issueTime = issue;
+            status.execCompleteTime = status.issueTime + deltas[2];
+            status.writeResultTime = status.execCompleteTime + deltas[3];
+            status.commitTime = status.writeResultTime + deltas[4];
+        }
+        return true;
+    }
+};
+
+// Timeline of the simulated instructions, indexed by instruction number.
+// Every instruction in flight holds a ROB entry, so their statuses fit in a
+// ring of robSize slots. At commit an entry leaves the ring and is streamed
+// to a timeline file, retained when it will be printed or returned, or
+// dropped, so the memory is bounded by the window unless retained.
+class Timeline
+{
+private:
+    vector<InstructionStatus> window;
+    int mask;
+    long long oldest;
+    long long issued;
+    bool retaining;
+    vector<InstructionStatus> retained;
+    TimelineWriter stream;
+
+    static const size_t RETAINED_MINIMUM = 4096;
+
+public:
+    explicit Timeline(int windowSize)
+        : mask(0), oldest(0), issued(0), retaining(false)
+    {
+        int slots = 1;
+        while (slots < windowSize)
+            slots <<= 1;
+        window.resize(slots);
+        mask = slots - 1;
+    }
+
+    InstructionStatus &operator[](long long index)
+    {
+        return window[index & mask];
+    }
+
+    const InstructionStatus &operator[](long long index) const
+    {
+        return window[index & mask];
+    }
+
+    long long size() const
+    {
+        return issued;
+    }
+
+    long long firstInFlight() const
+    {
+        return oldest;
+    }
+
+    long long issue(const Instruction &instruction)
+    {
+        window[issued & mask] = InstructionStatus(instruction);
+        return issued++;
+    }
+
+    // Drops the statuses of squashed instructions.
+    void truncate(long long size)
+    {
+        issued = size;
+    }
+
+    // Moves the oldest in-flight status out of the window; called in commit order.
+    void retire()
+    {
+        const InstructionStatus &status = window[oldest & mask];
+        if (stream.isOpen())
+            stream.append(status);
+        else if (retaining)
+            retained.push_back(status);
+        oldest++;
+    }
+
+    void retain(bool enabled)
+    {
+        retaining = enabled;
+    }
+
+    // Whether every committed status since the last restore is still held.
+    bool complete() const
+    {
+        return retaining && stream.path().empty();
+    }
+
+    // Makes room for `more` instructions beyond those issued so far, and for
+    // at least RETAINED_MINIMUM in all, so short streamed traces do not grow
+    // the retained timeline while they run.
+    void reserve(size_t more)
+    {
+        if (stream.isOpen() || !retaining)
+            return;
+
+        size_t needed = retained.size() + (issued - oldest) + more;
+        if (needed < RETAINED_MINIMUM)
+            needed = RETAINED_MINIMUM;
+        if (needed > retained.capacity())
+            retained.reserve(max(needed, 2 * retained.capacity()));
+    }
+
+    // Restarts numbering from the in-flight statuses of a checkpoint.
+    void restore(const vector<InstructionStatus> &statuses)
+    {
+        retained.clear();
+        oldest = 0;
+        issued = 0;
+        for (const InstructionStatus &status : statuses)
+            window[issued++ & mask] = status;
+    }
+
+    template <typename Visitor>
+    void forEach(Visitor visit) const
+    {
+        for (const InstructionStatus &status : retained)
+            visit(status);
+        for (long long i = oldest; i < issued; i++)
+            visit(window[i & mask]);
+    }
+
+    bool streamTo(const string &filePath)
+    {
+        return stream.open(filePath);
+    }
+
+    const TimelineWriter &streamed() const
+    {
+        return stream;
+    }
+
+    bool finishStream()
+    {
+        return stream.close();
+    }
+};
+
+struct CacheLevelStats
+{
+    long long hits = 0;
+    long long misses = 0;
+};
+
+class CacheLevel
+{
+private:
+    struct Way
+    {
+        bool valid;
+        long long tag;
+        long long stamp;
+    };
+
+    CacheLevelConfig config;
+    int setCount;
+    vector<Way> ways;
+    long long clock;
+    uint64_t randomState;
+
+public:
+    CacheLevelStats stats;
+
+    explicit CacheLevel(const CacheLevelConfig &config)
+        : config(config), clock(0), randomState(0x9E3779B97F4A7C15ULL)
+    {
+        setCount = max(1, config.sizeBytes / (config.lineBytes * config.associativity));
+        ways.assign(static_cast<size_t>(setCount) * config.associativity, {false, 0, 0});
+    }
+
+    int lineBytes() const
+    {
+        return config.lineBytes;
+    }
+
+    int hitLatency() const
+    {
+        return config.hitLatency;
+    }
+
+    // Lines of negative addresses are negative; the floor modulo keeps their
+    // set index in range.
+    bool access(long long line)
+    {
+        long long index = line % setCount;
+        if (index < 0)
+            index += setCount;
+        Way *set = &ways[static_cast<size_t>(index) * config.associativity];
+        clock++;
+
+        for (int w = 0; w < config.associativity; w++)
+        {
+            if (set[w].valid && set[w].tag == line)
+            {
+                if (config.policy == ReplacementPolicy::LRU)
+                    set[w].stamp = clock;
+                stats.hits++;
+                return true;
+            }
+        }
+
+        stats.misses++;
+
+        int victim = 0;
+        if (config.policy == ReplacementPolicy::Random)
+        {
+            randomState ^= randomState << 13;
+            randomState ^= randomState >> 7;
+            randomState ^= randomState << 17;
+            victim = randomState % config.associativity;
+        }
+
+        for (int w = 0; w < config.associativity; w++)
+        {
+            if (!set[w].valid)
+            {
+                victim = w;
+                break;
+            }
+            if (config.policy != ReplacementPolicy::Random && set[w].stamp < set[victim].stamp)
+                victim = w;
+        }
+
+        set[victim] = {true, line, clock};
+        return false;
+    }
+
+    void save(CheckpointWriter &writer) const
+    {
+        writer.putVector(ways);
+        writer.put(clock);
+        writer.put(randomState);
+        writer.put(stats);
+    }
+
+    void load(CheckpointReader &reader)
+    {
+        vector<Way> savedWays;
+        long long savedClock = 0;
+        uint64_t savedRandomState = 0;
+        CacheLevelStats savedStats;
+        reader.getVector(savedWays);
+        reader.get(savedClock);
+        reader.get(savedRandomState);
+        reader.get(savedStats);
+
+        if (savedWays.size() != ways.size())
+            return;
+
+        ways = savedWays;
+        clock = savedClock;
+        randomState = savedRandomState;
+        stats = savedStats;
+    }
+};
+
+class CacheHierarchy
+{
+private:
+    struct Mshr
+    {
+        long long line;
+        long long readyCycle;
+    };
+
+    CacheConfig config;
+    CacheLevel l1;
+    CacheLevel l2;
+    vector<Mshr> mshrs;
+
+    long long mshrMerges;
+    long long mshrStallCycles;
+    long long missCycles;
+    long long busyCycles;
+    long long busyUntil;
+
+public:
+    explicit CacheHierarchy(const CacheConfig &config)
+        : config(config), l1(config.l1), l2(config.l2), mshrs(max(1, config.mshrCount), {-1, 0}),
+          mshrMerges(0), mshrStallCycles(0), missCycles(0), busyCycles(0), busyUntil(0) {}
+
+    bool enabled() const
+    {
+        return config.enabled;
+    }
+
+    // Floor division, so negative addresses map to their own lines, as they
+    // map to their own pages in PagedMemory.
+    static long long lineOf(int address, int lineBytes)
+    {
+        long long byteAddress = static_cast<long long>(address) * 4;
+        long long line = byteAddress / lineBytes;
+        return byteAddress % lineBytes < 0 ? line - 1 : line;
+    }
+
+    int access(int address, long long now)
+    {
+        long long line = lineOf(address, l1.lineBytes());
+
+        for (const Mshr &mshr : mshrs)
+        {
+            if (mshr.line == line && mshr.readyCycle > now)
+            {
+                l1.access(line);
+                mshrMerges++;
+                return static_cast<int>(max<long long>(l1.hitLatency(), mshr.readyCycle - now));
+            }
+        }
+
+        if (l1.access(line))
+            return l1.hitLatency();
+
+        int latency = l1.hitLatency() + l2.hitLatency();
+        if (!l2.access(lineOf(address, l2.lineBytes())))
+            latency += config.memoryLatency;
+
+        Mshr *slot = &mshrs[0];
+        for (Mshr &mshr : mshrs)
+        {
+            if (mshr.readyCycle < slot->readyCycle)
+                slot = &mshr;
+        }
+
+        long long start = max(now, slot->readyCycle);
+        mshrStallCycles += start - now;
+        slot->line = line;
+        slot->readyCycle = start + latency;
+
+        missCycles += latency;
+        if (start >= busyUntil)
+            busyCycles += latency;
+        else if (slot->readyCycle > busyUntil)
+            busyCycles += slot->readyCycle - busyUntil;
+        busyUntil = max(busyUntil, slot->readyCycle);
+
+        return static_cast<int>(slot->readyCycle - now);
+    }
+
+    void warm(int address)
+    {
+        CacheLevelStats l1Stats = l1.stats;
+        CacheLevelStats l2Stats = l2.stats;
+
+        if (!l1.access(lineOf(address, l1.lineBytes())))
+            l2.access(lineOf(address, l2.lineBytes()));
+
+        l1.stats = l1Stats;
+        l2.stats = l2Stats;
+    }
+
+    void save(CheckpointWriter &writer) const
+    {
+        writer.put(config.enabled);
+        if (!config.enabled)
+            return;
+
+        l1.save(writer);
+        l2.save(writer);
+        writer.putVector(mshrs);
+        writer.put(mshrMerges);
+        writer.put(mshrStallCycles);
+        writer.put(missCycles);
+        writer.put(busyCycles);
+        writer.put(busyUntil);
+    }
+
+    void load(CheckpointReader &reader)
+    {
+        bool saved = false;
+        reader.get(saved);
+        if (!saved)
+            return;
+
+        l1.load(reader);
+        l2.load(reader);
+
+        vector<Mshr> savedMshrs;
+        reader.getVector(savedMshrs);
+        if (savedMshrs.size() == mshrs.size())
+            mshrs = savedMshrs;
+
+        reader.get(mshrMerges);
+        reader.get(mshrStallCycles);
+        reader.get(missCycles);
+        reader.get(busyCycles);
+        reader.get(busyUntil);
+    }
+
+    void printStatistics(ostream &out) const
+    {
+        auto printLevel = [&out](const char *name, const CacheLevelStats &stats)
+        {
+            long long total = stats.hits + stats.misses;
+            out << name << ": " << stats.hits << " hits, " << stats.misses << " misses";
+            if (total > 0)
+                out << " (hit rate " << 100.0 * stats.hits / total << "%)";
+            out << endl;
+        };
+
+        printLevel("L1", l1.stats);
+        printLevel("L2", l2.stats);
+        out << "MSHR merges: " << mshrMerges << ", MSHR stall cycles: " << mshrStallCycles << endl;
+        out << "Memory-level parallelism: " << (busyCycles > 0 ? static_cast<double>(missCycles) / busyCycles : 0.0) << endl;
+    }
+};
+
+class BranchPredictor
+{
+private:
+    PredictorConfig config;
+    vector<uint8_t> counters;
+    uint32_t globalHistory;
+    uint32_t tableMask;
+    uint32_t historyMask;
+
+    uint32_t indexOf(int pc, uint32_t history) const
+    {
+        uint32_t index = static_cast<uint32_t>(pc);
+        if (config.kind == PredictorKind::Gshare)
+            index ^= history;
+        return index & tableMask;
+    }
+
+public:
+    explicit BranchPredictor(const PredictorConfig &config)
+        : config(config), globalHistory(0), tableMask((1u << config.tableBits) - 1), historyMask((1u << config.historyBits) - 1)
+    {
+        if (config.kind != PredictorKind::Static)
+            counters.assign(size_t(1) << config.tableBits, 1);
+    }
+
+    const char *name() const
+    {
+        switch (config.kind)
+        {
+        case PredictorKind::Static:
+            return "static (backward taken, forward not taken)";
+        case PredictorKind::Bimodal:
+            return "bimodal";
+        case PredictorKind::Gshare:
+            return "gshare";
+        }
+        return "?";
+    }
+
+    uint32_t history() const
+    {
+        return globalHistory;
+    }
+
+    const vector<uint8_t> &table() const
+    {
+        return counters;
+    }
+
+    void setState(uint32_t history, const vector<uint8_t> &table)
+    {
+        globalHistory = history & historyMask;
+        if (table.size() == counters.size())
+            counters = table;
+    }
+
+    bool predict(int pc, int target) const
+    {
+        if (config.kind == PredictorKind::Static)
+            return target <= pc;
+        return counters[indexOf(pc, globalHistory)] >= 2;
+    }
+
+    void speculate(bool taken)
+    {
+        globalHistory = ((globalHistory << 1) | (taken ? 1 : 0)) & historyMask;
+    }
+
+    void restore(uint32_t history, bool taken)
+    {
+        globalHistory = history;
+        speculate(taken);
+    }
+
+    void train(int pc, bool taken)
+    {
+        update(pc, globalHistory, taken);
+        speculate(taken);
+    }
+
+    void update(int pc, uint32_t history, bool taken)
+    {
+        if (config.kind == PredictorKind::Static)
+            return;
+
+        uint8_t &counter = counters[indexOf(pc, history)];
+        if (taken && counter < 3)
+            counter++;
+        else if (!taken && counter > 0)
+            counter--;
+    }
+};
+
+enum class LoadCheck
+{
+    Clear,
+    Bypass,
+    Forward,
+    WaitAddress,
+    WaitData
+};
+
+struct PendingBranch
+{
+    int pc;
+    bool conditional;
+    bool predictedTaken;
+    bool taken;
+    uint32_t history;
+    long long cyclesLost;
+};
+
+struct BranchSiteStats
+{
+    Instruction instruction;
+    long long executions = 0;
+    long long mispredictions = 0;
+    long long cyclesLost = 0;
+};
+
+enum class CommitStall : uint8_t
+{
+    Frontend,
+    AddSub,
+    MulDiv,
+    Load,
+    Store,
+    Branch
+};
+
+static const int COMMIT_STALL_COUNT = 6;
+
+const char *commitStallName(CommitStall cause)
+{
+    switch (cause)
+    {
+    case CommitStall::Frontend:
+        return "frontend (empty ROB)";
+    case CommitStall::AddSub:
+        return "ADD/SUB";
+    case CommitStall::MulDiv:
+        return "MUL/DIV";
+    case CommitStall::Load:
+        return "load";
+    case CommitStall::Store:
+        return "store";
+    case CommitStall::Branch:
+        return "branch";
+    }
+    return "?";
+}
+
+struct MicroStats
+{
+    long long noStationStalls[UNIT_COUNT] = {};
+    long long operandWaitCycles[UNIT_COUNT] = {};
+    vector<long long> robOccupancy;
+    vector<long long> stationOccupancy[UNIT_COUNT];
+    vector<long long> physicalOccupancy;
+    long long commitSlots = 0;
+    long long stallSlots[COMMIT_STALL_COUNT] = {};
+};
+
+struct CheckpointHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t payloadSize;
+    uint64_t checksum;
+};
+
+static const char CHECKPOINT_MAGIC[4] = {'T', 'M', 'C', 'K'};
+static const uint32_t CHECKPOINT_VERSION = 5;
+
+struct StationState
+{
+    Opcode op;
+    bool hasAddress;
+    bool busy;
+    bool started;
+    bool forwarded;
+    int qj, qk;
+    int vj, vk;
+    int destRobTag;
+    int addr;
+    int imm;
+    long long instructionIndex;
+    int remainingCycles;
+    int forwardedValue;
+};
+
+struct MemoryWord
+{
+    int32_t address;
+    int32_t value;
+};
+
+static int physicalRegisterCount(const TomasuloConfig &config)
+{
+    return config.physicalRegisters > 0 ? config.physicalRegisters : NUM_REGISTERS + config.robSize;
+}
+
+class Tomasulo::Core
+{
+private:
+    TraceStream instructions;
+    Timeline instructionsStatus;
+    StationFile stations;
+    vector<FunctionalUnitPool> pools;
+    bool pooling;
+    vector<pair<long long, int>> dispatchCandidates;
+    vector<ROBEntry> rob;
+    vector<int> wakeupHead;
+    vector<int> wakeupNext;
+    vector<Register> registers;
+    PhysicalRegisterFile physical;
+    PagedMemory memory;
+    CacheHierarchy cache;
+    BranchPredictor predictor;
+    vector<PendingBranch> pendingBranches;
+    vector<bool> usedRegisters;
+    StateTraceWriter stateTrace;
+
+    long long cycle;
+    bool isCompleted;
+    bool eventDriven;
+    bool draining;
+    OutputLevel outputLevel;
+    int sampleInterval;
+    bool timelineRetained;
+    ostream *output;
+    TomasuloConfig config;
+    int robSize;
+    int robHead, robTail;
+    long long robFullStalls;
+    long long stationFullStalls;
+    long long cdbConflictStalls;
+    long long physicalRegisterStalls;
+    vector<long long> cdbCandidates;
+    vector<int> storeQueue;
+    int storeQueueHead;
+    int storeQueueCount;
+    LsqStats lsqStats;
+    BranchStats branchStats;
+    vector<pair<int, BranchSiteStats>> branchSites; // sorted by PC
+    long long committedInstructions;
+    long long fastForwardedInstructions;
+    long long cycleLimit;
+    vector<pair<int, int>> *storeLog;
+#ifndef TOMASULO_NO_STATS
+    MicroStats stats;
+#endif
+
+    static const size_t TRACE_RING_CAPACITY = 4096;
+    static const size_t BRANCH_SITE_CAPACITY = 256;
+
+public:
+    explicit Core(const TomasuloConfig &config)
+        : instructions(TRACE_RING_CAPACITY), instructionsStatus(config.robSize), stations(config.addStations, config.mulStations, config.loadStoreStations),
+          registers(NUM_REGISTERS), physical(config.renaming == RenameMode::PhysicalRegisters ? physicalRegisterCount(config) : 0),
+          cache(config.cache), predictor(config.predictor),
+          pendingBranches(config.robSize), usedRegisters(NUM_REGISTERS, false),
+          cycle(0), isCompleted(false), eventDriven(false), draining(false),
+          outputLevel(OutputLevel::Full), sampleInterval(1), timelineRetained(false), output(&cout), config(config), robSize(config.robSize),
+          robHead(0), robTail(0), robFullStalls(0), stationFullStalls(0), cdbConflictStalls(0),
+          physicalRegisterStalls(0), storeQueue(config.robSize), storeQueueHead(0), storeQueueCount(0), committedInstructions(0),
+          fastForwardedInstructions(0), cycleLimit(LLONG_MAX), storeLog(nullptr)
+    {
+        rob.resize(robSize);
+        pools.emplace_back(config.adders, config.addSubLatency);
+        pools.emplace_back(config.multipliers, config.mulLatency);
+        pools.emplace_back(config.dividers, config.divLatency);
+        pooling = config.adders.count > 0 || config.multipliers.count > 0 || config.dividers.count > 0;
+
+        wakeupHead.assign(robSize, -1);
+        wakeupNext.assign(2 * stations.count(), -1);
+        cdbCandidates.reserve(robSize);
+        dispatchCandidates.reserve(stations.count());
+        branchSites.reserve(BRANCH_SITE_CAPACITY);
+        instructionsStatus.retain(retainsTimeline());
+        for (FunctionalUnitPool &pool : pools)
+        {
+            if (pool.enabled())
+                pool.operations.reserve(robSize);
+        }
+        resetRenaming();
+
+#ifndef TOMASULO_NO_STATS
+        stats.robOccupancy.assign(robSize + 1, 0);
+        stats.physicalOccupancy.assign(physical.size() + 1, 0);
+        for (int unit = 0; unit < UNIT_COUNT; unit++)
+            stats.stationOccupancy[unit].assign(stations.end(static_cast<Unit>(unit)) - stations.begin(static_cast<Unit>(unit)) + 1, 0);
+#endif
+    }
+
+    bool loadInstructions(const string &filePath)
+    {
+        return instructions.open(filePath);
+    }
+
+    bool generateInstructions(const GeneratorConfig &generator, const string &outputPath)
+    {
+        return instructions.generate(generator, outputPath);
+    }
+
+    void useInstructions(const vector<Instruction> &trace)
+    {
+        instructions.attach(trace.data(), trace.size());
+    }
+
+    RunSummary summary() const
+    {
+        return {cycle, static_cast<long long>(instructionsStatus.size()), robFullStalls, stationFullStalls, cdbConflictStalls,
+                physicalRegisterStalls};
+    }
+
+    void run()
+    {
+        reserveTimeline();
+        while (step())
+        {
+        }
+        finish();
+    }
+
+    bool step()
+    {
+        if (isCompleted)
+            return false;
+
+        if (eventDriven)
+            skipIdleCycles();
+
+        commit();
+        writeResults();
+        executeInstructions();
+        if (!draining)
+            issueInstruction();
+
+        if (shouldPrintCycle())
+        {
+            *output << "\n=== Cycle " << cycle + 1 << " ===\n";
+            printState();
+        }
+
+        if (stateTrace.isOpen())
+            stateTrace.record(cycle + 1, stations, rob, registers, usedRegisters);
+
+        cycle++;
+        isCompleted = checkSimulationComplete();
+        return !isCompleted;
+    }
+
+    bool runUntil(long long limit)
+    {
+        cycleLimit = limit;
+        reserveTimeline();
+        while (cycle < cycleLimit && step())
+        {
+        }
+        cycleLimit = LLONG_MAX;
+        return !isCompleted;
+    }
+
+    // A retained timeline keeps an entry per committed instruction.
+    // Reserving the rest of a trace of known length up front keeps the cycle
+    // loop free of reallocations; streamed traces and programs that loop past
+    // their static length grow it geometrically from there. Timelines that
+    // are streamed to a file or not retained reserve nothing.
+    void reserveTimeline()
+    {
+        size_t length = instructions.length();
+        instructionsStatus.reserve(length > instructions.position() ? length - instructions.position() : 0);
+    }
+
+    void recordStores(vector<pair<int, int>> *log)
+    {
+        storeLog = log;
+    }
+
+    void finish()
+    {
+        stateTrace.close();
+        instructionsStatus.finishStream();
+
+        if (outputLevel != OutputLevel::Silent)
+            printFinalResults();
+    }
+
+    long long committed() const
+    {
+        return committedInstructions;
+    }
+
+    bool completed() const
+    {
+        return isCompleted;
+    }
+
+    void drain()
+    {
+        draining = true;
+        while (rob[robHead].busy && step())
+        {
+        }
+        draining = false;
+    }
+
+    long long fastForward(long long count, long long warmup = 0)
+    {
+        drain();
+
+        long long executed = 0;
+        long long warmupStart = count - warmup;
+        while (executed < count)
+        {
+            const Instruction *next = instructions.peek();
+            if (next == nullptr)
+                break;
+
+            const Instruction instruction = *next;
+            bool warm = executed >= warmupStart;
+            markUsedRegisters(instruction);
+
+            switch (instruction.op)
+            {
+            case Opcode::ADD:
+            case Opcode::SUB:
+            case Opcode::MUL:
+            case Opcode::DIV:
+                registers[instruction.rd].value = arithmeticResult(instruction.op, registers[instruction.rs1].value,
+                                                                   registers[instruction.rs2].value);
+                break;
+            case Opcode::LW:
+            {
+                int address = wrappingAdd(registers[instruction.rs1].value, instruction.imm);
+                if (warm && cache.enabled())
+                    cache.warm(address);
+                registers[instruction.rd].value = memory.read(address);
+                break;
+            }
+            case Opcode::SW:
+            {
+                int address = wrappingAdd(registers[instruction.rs1].value, instruction.imm);
+                if (warm && cache.enabled())
+                    cache.warm(address);
+                memory.write(address, registers[instruction.rs2].value);
+                break;
+            }
+            case Opcode::BEQ:
+            case Opcode::BNE:
+            {
+                bool taken = (registers[instruction.rs1].value == registers[instruction.rs2].value) == (instruction.op == Opcode::BEQ);
+                if (warm)
+                    predictor.train(static_cast<int>(instructions.position()), taken);
+                if (taken)
+                {
+                    instructions.seek(instruction.imm);
+                    executed++;
+                    continue;
+                }
+                break;
+            }
+            case Opcode::J:
+                instructions.seek(instruction.imm);
+                executed++;
+                continue;
+            }
+
+            instructions.pop();
+            executed++;
+        }
+
+        committedInstructions += executed;
+        fastForwardedInstructions += executed;
+        resetRenaming();
+        isCompleted = checkSimulationComplete();
+        return executed;
+    }
+
+    vector<char> checkpoint() const
+    {
+        CheckpointWriter writer;
+        writer.put(config.addStations);
+        writer.put(config.mulStations);
+        writer.put(config.loadStoreStations);
+        writer.put(robSize);
+
+        writer.put(cycle);
+        writer.put(committedInstructions);
+        writer.put(robFullStalls);
+        writer.put(stationFullStalls);
+        writer.put(cdbConflictStalls);
+        writer.put(physicalRegisterStalls);
+        writer.put(lsqStats);
+        writer.put(branchStats);
+        writer.put(fastForwardedInstructions);
+        writer.put<uint64_t>(instructions.position());
+        writer.put(predictor.history());
+        writer.putVector(predictor.table());
+        cache.save(writer);
+
+        writer.put(robHead);
+        writer.put(robTail);
+        writer.putVector(rob);
+        writer.putVector(pendingBranches);
+        writer.putVector(storeQueue);
+        writer.put(storeQueueHead);
+        writer.put(storeQueueCount);
+
+        vector<StationState> stationStates;
+        for (int id = 0; id < stations.count(); id++)
+        {
+            stationStates.push_back({stations.op[id], stations.hasAddress[id] != 0, stations.busy(id), stations.started[id] != 0,
+                                     stations.forwarded[id] != 0, stations.qj[id], stations.qk[id], stations.vj[id], stations.vk[id],
+                                     stations.destRobTag[id], stations.addr[id], stations.imm[id], stations.instructionIndex[id],
+                                     stations.remainingCycles[id], stations.forwardedValue[id]});
+        }
+        writer.putVector(stationStates);
+        for (const FunctionalUnitPool &pool : pools)
+            pool.save(writer);
+
+        writer.putVector(registers);
+        writer.putVector(vector<uint8_t>(usedRegisters.begin(), usedRegisters.end()));
+        physical.save(writer);
+
+        vector<MemoryWord> words;
+        memory.forEachNonZero([&words](int address, int value)
+                              { words.push_back({address, value}); });
+        writer.putVector(words);
+
+        long long firstInFlight = instructionsStatus.firstInFlight();
+        vector<InstructionStatus> inFlight;
+        for (long long i = firstInFlight; i < instructionsStatus.size(); i++)
+            inFlight.push_back(instructionsStatus[i]);
+        writer.put(firstInFlight);
+        writer.putVector(inFlight);
+
+        return move(writer.data());
+    }
+
+    bool restore(const vector<char> &bytes)
+    {
+        CheckpointReader reader(bytes);
+        int shape[4] = {0, 0, 0, 0};
+        for (int &field : shape)
+            reader.get(field);
+
+        long long savedCycle = 0;
+        long long savedCommitted = 0;
+        long long savedStalls[4] = {0, 0, 0, 0};
+        uint64_t position = 0;
+        uint32_t history = 0;
+        reader.get(savedCycle);
+        reader.get(savedCommitted);
+        for (long long &stalls : savedStalls)
+            reader.get(stalls);
+        vector<uint8_t> predictorTable;
+        LsqStats savedLsqStats;
+        BranchStats savedBranchStats;
+        reader.get(savedLsqStats);
+        reader.get(savedBranchStats);
+        long long savedFastForwarded = 0;
+        reader.get(savedFastForwarded);
+        reader.get(position);
+        reader.get(history);
+        reader.getVector(predictorTable);
+
+        CacheHierarchy savedCache(config.cache);
+        savedCache.load(reader);
+
+        int savedHead = 0, savedTail = 0, savedStoreHead = 0, savedStoreCount = 0;
+        vector<ROBEntry> savedRob;
+        vector<PendingBranch> savedBranches;
+        vector<int> savedStoreQueue;
+        vector<StationState> stationStates;
+        vector<Register> savedRegisters;
+        vector<uint8_t> savedUsed;
+        vector<MemoryWord> words;
+        long long firstInFlight = 0;
+        vector<InstructionStatus> statuses;
+
+        reader.get(savedHead);
+        reader.get(savedTail);
+        reader.getVector(savedRob);
+        reader.getVector(savedBranches);
+        reader.getVector(savedStoreQueue);
+        reader.get(savedStoreHead);
+        reader.get(savedStoreCount);
+        reader.getVector(stationStates);
+        vector<FunctionalUnitPool> savedPools = pools;
+        for (FunctionalUnitPool &pool : savedPools)
+            pool.load(reader);
+        reader.getVector(savedRegisters);
+        reader.getVector(savedUsed);
+        PhysicalRegisterFile savedPhysical(0);
+        bool physicalValid = savedPhysical.load(reader);
+        reader.getVector(words);
+        reader.get(firstInFlight);
+        reader.getVector(statuses);
+
+        if (!reader.ok() || !physicalValid || savedRegisters.size() != registers.size() || savedUsed.size() != usedRegisters.size())
+        {
+            cerr << "Malformed checkpoint" << endl;
+            return false;
+        }
+
+        bool drained = none_of(savedRob.begin(), savedRob.end(), [](const ROBEntry &entry)
+                               { return entry.busy; });
+        bool sameShape = shape[0] == config.addStations && shape[1] == config.mulStations &&
+                         shape[2] == config.loadStoreStations && shape[3] == robSize &&
+                         savedPhysical.size() == physical.size();
+        for (int pool = 0; pool < POOL_COUNT; pool++)
+            sameShape = sameShape && savedPools[pool].count() == pools[pool].count();
+        if (!drained && !sameShape)
+        {
+            cerr << "Checkpoint has instructions in flight and a different station/ROB/register file/functional unit configuration" << endl;
+            return false;
+        }
+
+        // Every index the restored core will follow is checked before any
+        // state is replaced, so a corrupt checkpoint is rejected instead of
+        // indexing past the end of an array.
+        auto isRobTag = [this](int tag)
+        { return tag >= 0 && tag < robSize; };
+        auto isOperandTag = [&isRobTag](int tag)
+        { return tag == -1 || isRobTag(tag); };
+        long long endInFlight = firstInFlight + static_cast<long long>(statuses.size());
+        auto isInFlight = [drained, firstInFlight, endInFlight](long long index)
+        { return !drained && index >= firstInFlight && index < endInFlight; };
+        // A station or unit operation must point at the ROB entry of its own instruction.
+        auto ownsEntry = [&savedRob, &isRobTag, &isInFlight](int tag, long long index, Opcode op)
+        {
+            return static_cast<int>(op) < OPCODE_COUNT && isInFlight(index) && isRobTag(tag) &&
+                   static_cast<size_t>(tag) < savedRob.size() && savedRob[tag].busy &&
+                   savedRob[tag].instructionIndex == index && savedRob[tag].type == typeOf(op);
+        };
+
+        bool indicesValid = statuses.size() <= static_cast<size_t>(robSize);
+        for (int pool = 0; pool < POOL_COUNT; pool++)
+        {
+            if (savedPools[pool].count() != pools[pool].count())
+                continue;
+            for (const UnitOperation &operation : savedPools[pool].operations)
+                indicesValid = indicesValid && ownsEntry(operation.destRobTag, operation.instructionIndex, operation.op);
+        }
+        if (!drained)
+        {
+            indicesValid = indicesValid && savedRob.size() == rob.size() && savedBranches.size() == pendingBranches.size() &&
+                           savedStoreQueue.size() == storeQueue.size() && static_cast<int>(stationStates.size()) == stations.count() &&
+                           isRobTag(savedHead) && isRobTag(savedTail) && isRobTag(savedStoreHead) &&
+                           savedStoreCount >= 0 && savedStoreCount <= robSize;
+            for (int i = 0; indicesValid && i < savedStoreCount; i++)
+                indicesValid = isRobTag(savedStoreQueue[(savedStoreHead + i) % robSize]);
+            for (const ROBEntry &entry : savedRob)
+            {
+                if (!indicesValid || !entry.busy)
+                    continue;
+                indicesValid = entry.type <= InstrType::Branch && isInFlight(entry.instructionIndex);
+                if (indicesValid && writesRegister(entry.type))
+                {
+                    indicesValid = entry.destination >= 0 && entry.destination < NUM_REGISTERS;
+                    if (renamesPhysically())
+                        indicesValid = indicesValid && entry.physical >= 0 && entry.physical < savedPhysical.size() &&
+                                       entry.previousPhysical >= 0 && entry.previousPhysical < savedPhysical.size();
+                }
+            }
+            for (const StationState &state : stationStates)
+            {
+                if (state.busy)
+                    indicesValid = indicesValid && isOperandTag(state.qj) && isOperandTag(state.qk) &&
+                                   ownsEntry(state.destRobTag, state.instructionIndex, state.op);
+            }
+            for (const Register &reg : savedRegisters)
+                indicesValid = indicesValid && isOperandTag(reg.robTag);
+            for (int p = 0; p < savedPhysical.size(); p++)
+                indicesValid = indicesValid && isOperandTag(savedPhysical.producer(p));
+        }
+        if (!indicesValid)
+        {
+            cerr << "Malformed checkpoint" << endl;
+            return false;
+        }
+
+        if (!instructions.seek(position))
+        {
+            cerr << "Checkpoint trace position is past the end of the trace" << endl;
+            return false;
+        }
+
+        cycle = savedCycle;
+        committedInstructions = savedCommitted;
+        robFullStalls = savedStalls[0];
+        stationFullStalls = savedStalls[1];
+        cdbConflictStalls = savedStalls[2];
+        physicalRegisterStalls = savedStalls[3];
+        lsqStats = savedLsqStats;
+        branchStats = savedBranchStats;
+        fastForwardedInstructions = savedFastForwarded;
+        predictor.setState(history, predictorTable);
+        cache = savedCache;
+
+        for (int id = 0; id < stations.count(); id++)
+            stations.reset(id);
+
+        for (int pool = 0; pool < POOL_COUNT; pool++)
+        {
+            if (savedPools[pool].count() == pools[pool].count())
+            {
+                pools[pool] = savedPools[pool];
+                for (UnitOperation &operation : pools[pool].operations)
+                    operation.instructionIndex -= firstInFlight;
+            }
+            else
+            {
+                pools[pool].reset();
+                pools[pool].stats = savedPools[pool].stats;
+            }
+        }
+
+        if (drained)
+        {
+            robHead = robTail = 0;
+            rob.assign(robSize, ROBEntry());
+            pendingBranches.assign(robSize, PendingBranch());
+            storeQueueHead = storeQueueCount = 0;
+        }
+        else
+        {
+            robHead = savedHead;
+            robTail = savedTail;
+            rob = savedRob;
+            pendingBranches = savedBranches;
+            storeQueue = savedStoreQueue;
+            storeQueueHead = savedStoreHead;
+            storeQueueCount = savedStoreCount;
+
+            for (ROBEntry &entry : rob)
+                entry.instructionIndex -= firstInFlight;
+
+            // Free stations stay as reset; issue relies on their cleared tags.
+            for (int id = 0; id < static_cast<int>(stationStates.size()); id++)
+            {
+                const StationState &state = stationStates[id];
+                if (!state.busy)
+                    continue;
+
+                stations.op[id] = state.op;
+                stations.hasAddress[id] = state.hasAddress;
+                stations.started[id] = state.started;
+                stations.forwarded[id] = state.forwarded;
+                stations.qj[id] = state.qj;
+                stations.qk[id] = state.qk;
+                stations.vj[id] = state.vj;
+                stations.vk[id] = state.vk;
+                stations.destRobTag[id] = state.destRobTag;
+                stations.addr[id] = state.addr;
+                stations.imm[id] = state.imm;
+                stations.instructionIndex[id] = state.instructionIndex - firstInFlight;
+                stations.remainingCycles[id] = state.remainingCycles;
+                stations.forwardedValue[id] = state.forwardedValue;
+
+                stations.allocate(id);
+                stations.updateReady(id);
+                if (state.remainingCycles == 0)
+                    stations.markDone(id);
+            }
+        }
+
+        registers = savedRegisters;
+        if (drained)
+        {
+            for (Register &reg : registers)
+                reg.robTag = -1;
+            resetRenaming();
+        }
+        else
+        {
+            physical = savedPhysical;
+        }
+        usedRegisters.assign(savedUsed.begin(), savedUsed.end());
+
+        memory.clear();
+        for (const MemoryWord &word : words)
+            memory.write(word.address, word.value);
+
+        instructionsStatus.restore(drained ? vector<InstructionStatus>() : statuses);
+        rebuildWakeups();
+        isCompleted = false;
+        return true;
+    }
+
+    bool saveCheckpoint(const string &filePath) const
+    {
+        vector<char> payload = checkpoint();
+
+        CheckpointHeader header = {};
+        memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        header.version = CHECKPOINT_VERSION;
+        header.payloadSize = payload.size();
+        header.checksum = traceChecksum(TRACE_CHECKSUM_SEED, payload.data(), payload.size());
+
+        FILE *output = fopen(filePath.c_str(), "wb");
+        if (output == nullptr)
+        {
+            cerr << "Error creating file: " << filePath << endl;
+            return false;
+        }
+
+        bool ok = fwrite(&header, sizeof(header), 1, output) == 1 &&
+                  fwrite(payload.data(), 1, payload.size(), output) == payload.size();
+        ok = (fclose(output) == 0) && ok;
+        if (!ok)
+            cerr << "Error writing file: " << filePath << endl;
+        return ok;
+    }
+
+    bool restoreCheckpoint(const string &filePath)
+    {
+        vector<char> payload;
+        return readCheckpoint(filePath, payload) && restore(payload);
+    }
+
+    static bool readCheckpoint(const string &filePath, vector<char> &payload)
+    {
+        FILE *input = fopen(filePath.c_str(), "rb");
+        if (input == nullptr)
+        {
+            cerr << "Error opening file: " << filePath << endl;
+            return false;
+        }
+
+        CheckpointHeader header;
+        bool ok = fread(&header, sizeof(header), 1, input) == 1 &&
+                  memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) == 0 &&
+                  header.version == CHECKPOINT_VERSION;
+        if (ok)
+        {
+            payload.resize(header.payloadSize);
+            ok = fread(payload.data(), 1, payload.size(), input) == payload.size() &&
+                 traceChecksum(TRACE_CHECKSUM_SEED, payload.data(), payload.size()) == header.checksum;
+        }
+        fclose(input);
+
+        if (!ok)
+            cerr << "Invalid checkpoint: " << filePath << endl;
+        return ok;
+    }
+
+    void setOutputLevel(OutputLevel level, int interval = 1)
+    {
+        outputLevel = level;
+        sampleInterval = max(1, interval);
+        instructionsStatus.retain(retainsTimeline());
+    }
+
+    void setTimelineRetained(bool retained)
+    {
+        timelineRetained = retained;
+        instructionsStatus.retain(retainsTimeline());
+    }
+
+    void setOutputStream(ostream &stream)
+    {
+        output = &stream;
+    }
+
+    bool setStateTrace(const string &filePath)
+    {
+        vector<string> names;
+        for (int id = 0; id < stations.count(); id++)
+            names.push_back(stations.name(id));
+
+        return stateTrace.open(filePath, names, rob.size());
+    }
+
+    bool setTimelineFile(const string &filePath)
+    {
+        return instructionsStatus.streamTo(filePath);
+    }
+
+    void setEventDriven(bool enabled)
+    {
+        eventDriven = enabled;
+    }
+
+    void setRegister(const string &index, int value)
+    {
+        int reg = parseRegister(index);
+        if (reg == -1)
+        {
+            cerr << "Invalid register: " << index << endl;
+            return;
+        }
+        registers[reg].value = value;
+        resetRenaming();
+    }
+
+
+    void setMemory(int address, int value)
+    {
+        memory.write(address, value);
+    }
+
+    void setInitialState(const InitialState &state)
+    {
+        for (const auto &entry : state.registers)
+        {
+            if (entry.first < 0 || entry.first >= NUM_REGISTERS)
+                cerr << "Invalid register: " << entry.first << endl;
+            else
+                registers[entry.first].value = entry.second;
+        }
+        for (const auto &entry : state.memory)
+            memory.write(entry.first, entry.second);
+        resetRenaming();
+    }
+
+    SimulationResult result() const
+    {
+        SimulationResult result;
+        result.summary = summary();
+        result.fastForwardedInstructions = fastForwardedInstructions;
+        instructionsStatus.forEach([&result](const InstructionStatus &status)
+                                   { result.timeline.push_back(status); });
+        for (const Register &reg : registers)
+            result.registers.push_back(reg.value);
+        memory.forEachNonZero([&result](int address, int value)
+                              { result.memory[address] = value; });
+        result.branches = branchStats;
+        result.lsq = lsqStats;
+        result.adders = pools[static_cast<int>(Pool::Adder)].stats;
+        result.multipliers = pools[static_cast<int>(Pool::Multiplier)].stats;
+        result.dividers = pools[static_cast<int>(Pool::Divider)].stats;
+        return result;
+    }
+
+private:
+    bool renamesPhysically() const
+    {
+        return config.renaming == RenameMode::PhysicalRegisters;
+    }
+
+    // Committed statuses are kept only when something will read them: the
+    // final results of full or sampled output, or result() when asked for.
+    bool retainsTimeline() const
+    {
+        return timelineRetained || outputLevel == OutputLevel::Full || outputLevel == OutputLevel::Sampled;
+    }
+
+    void resetRenaming()
+    {
+        if (renamesPhysically())
+            physical.reset(registers);
+    }
+
+    static InstrType typeOf(Opcode op)
+    {
+        if (op == Opcode::LW)
+            return InstrType::Load;
+        if (op == Opcode::SW)
+            return InstrType::Store;
+        if (isBranch(op))
+            return InstrType::Branch;
+        return InstrType::Arith;
+    }
+
+    static bool writesRegister(InstrType type)
+    {
+        return type == InstrType::Arith || type == InstrType::Load;
+    }
+
+    int latencyOf(Opcode op) const
+    {
+        switch (op)
+        {
+        case Opcode::ADD:
+        case Opcode::SUB:
+        case Opcode::BEQ:
+        case Opcode::BNE:
+            return config.addSubLatency;
+        case Opcode::MUL:
+            return config.mulLatency;
+        case Opcode::DIV:
+            return config.divLatency;
+        case Opcode::LW:
+        case Opcode::SW:
+            return config.loadStoreLatency;
+        case Opcode::J:
+            return 0;
+        }
+        return 0;
+    }
+
+    void markUsedRegisters(const Instruction &instruction)
+    {
+        if (instruction.op == Opcode::J)
+            return;
+
+        usedRegisters[instruction.rs1] = true;
+        if (instruction.op == Opcode::SW || isBranch(instruction.op))
+        {
+            usedRegisters[instruction.rs2] = true;
+        }
+        else
+        {
+            usedRegisters[instruction.rd] = true;
+            if (instruction.op != Opcode::LW)
+                usedRegisters[instruction.rs2] = true;
+        }
+    }
+
+    void readOperand(int reg, int &value, int &tag)
+    {
+        if (renamesPhysically())
+        {
+            int source = physical.lookup(reg);
+            if (physical.isReady(source))
+                value = physical.value(source);
+            else
+                tag = physical.producer(source);
+            return;
+        }
+
+        const Register &source = registers[reg];
+        if (source.robTag == -1)
+        {
+            value = source.value;
+            return;
+        }
+
+        const ROBEntry &entry = rob[source.robTag];
+        if (entry.ready)
+            value = entry.value;
+        else
+            tag = source.robTag;
+    }
+
+    void issueInstruction()
+    {
+        for (int slot = 0; slot < config.issueWidth; slot++)
+        {
+            if (!issueOne())
+                return;
+        }
+    }
+
+    bool issueOne()
+    {
+        if (instructions.empty())
+            return false;
+
+        if (rob[robTail].busy)
+        {
+            robFullStalls++;
+            return false;
+        }
+
+        const Instruction instruction = *instructions.peek();
+        if (instruction.op == Opcode::J)
+        {
+            issueJump(instruction);
+            return true;
+        }
+
+        int rs = stations.firstFree(unitOf(instruction.op));
+        if (rs == -1)
+        {
+            stationFullStalls++;
+            TOMASULO_STAT(stats.noStationStalls[static_cast<int>(unitOf(instruction.op))]++);
+            return false;
+        }
+
+        InstrType type = typeOf(instruction.op);
+        if (renamesPhysically() && writesRegister(type) && !physical.hasFree())
+        {
+            physicalRegisterStalls++;
+            return false;
+        }
+
+        int pc = static_cast<int>(instructions.position());
+        instructions.pop();
+        markUsedRegisters(instruction);
+
+        long long instructionIndex = instructionsStatus.issue(instruction);
+
+        auto &status = instructionsStatus[instructionIndex];
+        status.issueTime = cycle + 1;
+
+        int destination = type == InstrType::Branch ? instruction.imm : instruction.rd;
+        rob[robTail] = {true, false, type, destination, false, 0, instructionIndex, false, 0, -1, -1};
+
+        stations.allocate(rs);
+        stations.op[rs] = instruction.op;
+        stations.instructionIndex[rs] = instructionIndex;
+        stations.destRobTag[rs] = robTail;
+        stations.remainingCycles[rs] = latencyOf(instruction.op);
+        stations.imm[rs] = instruction.imm;
+
+        readOperand(instruction.rs1, stations.vj[rs], stations.qj[rs]);
+        if (instruction.op != Opcode::LW)
+            readOperand(instruction.rs2, stations.vk[rs], stations.qk[rs]);
+
+        if (stations.qj[rs] != -1)
+            addWakeup(stations.qj[rs], 2 * rs);
+        if (stations.qk[rs] != -1)
+            addWakeup(stations.qk[rs], 2 * rs + 1);
+        stations.updateReady(rs);
+
+        if (stations.qj[rs] == -1)
+        {
+            if (instruction.op == Opcode::LW)
+            {
+                stations.addr[rs] = wrappingAdd(stations.vj[rs], instruction.imm);
+                stations.hasAddress[rs] = true;
+            }
+            else if (instruction.op == Opcode::SW)
+            {
+                rob[robTail].destination = wrappingAdd(stations.vj[rs], instruction.imm);
+                rob[robTail].hasAddress = true;
+            }
+        }
+
+        if (type == InstrType::Store)
+        {
+            rob[robTail].storeDataReady = stations.qk[rs] == -1;
+            rob[robTail].storeData = stations.vk[rs];
+            storeQueue[(storeQueueHead + storeQueueCount) % robSize] = robTail;
+            storeQueueCount++;
+        }
+        else if (type == InstrType::Branch)
+        {
+            predictBranch(pc, instruction.imm);
+        }
+        else if (renamesPhysically())
+        {
+            rob[robTail].physical = physical.allocate(instruction.rd, robTail, rob[robTail].previousPhysical);
+        }
+        else
+        {
+            registers[instruction.rd].robTag = robTail;
+        }
+
+        robTail = (robTail + 1) % robSize;
+        return true;
+    }
+
+    void issueJump(const Instruction &instruction)
+    {
+        instructions.seek(instruction.imm);
+        markUsedRegisters(instruction);
+
+        long long instructionIndex = instructionsStatus.issue(instruction);
+
+        auto &status = instructionsStatus[instructionIndex];
+        status.issueTime = status.execCompleteTime = status.writeResultTime = cycle + 1;
+
+        rob[robTail] = {true, true, InstrType::Branch, instruction.imm, false, 0, instructionIndex, false, 0, -1, -1};
+        pendingBranches[robTail] = {-1, false, true, true, predictor.history(), 0};
+        robTail = (robTail + 1) % robSize;
+    }
+
+    void predictBranch(int pc, int target)
+    {
+        bool taken = predictor.predict(pc, target);
+        pendingBranches[robTail] = {pc, true, taken, taken, predictor.history(), 0};
+        predictor.speculate(taken);
+
+        if (taken)
+            instructions.seek(target);
+    }
+
+    void resolveBranch(int robTag, bool taken)
+    {
+        PendingBranch &branch = pendingBranches[robTag];
+        branch.taken = taken;
+        if (taken == branch.predictedTaken)
+            return;
+
+        long long instructionIndex = rob[robTag].instructionIndex;
+        branch.cyclesLost = cycle + 1 - instructionsStatus[instructionIndex].issueTime;
+        predictor.restore(branch.history, taken);
+
+        squashYoungerThan(robTag);
+        instructions.seek(taken ? rob[robTag].destination : branch.pc + 1);
+    }
+
+    void squashYoungerThan(int robTag)
+    {
+        long long instructionIndex = rob[robTag].instructionIndex;
+
+        stations.forEachBusy([this, instructionIndex](int id)
+                             {
+            if (stations.instructionIndex[id] > instructionIndex)
+                stations.reset(id); });
+        for (FunctionalUnitPool &pool : pools)
+            pool.squashYoungerThan(instructionIndex);
+
+        int newTail = (robTag + 1) % robSize;
+        if (renamesPhysically())
+        {
+            for (int i = robTail; i != newTail;)
+            {
+                i = (i + robSize - 1) % robSize;
+                if (writesRegister(rob[i].type))
+                    physical.undo(rob[i].destination, rob[i].physical, rob[i].previousPhysical);
+            }
+        }
+        for (int i = newTail; i != robTail; i = (i + 1) % robSize)
+            rob[i].busy = false;
+        robTail = newTail;
+
+        while (storeQueueCount > 0 &&
+               rob[storeQueue[(storeQueueHead + storeQueueCount - 1) % robSize]].instructionIndex > instructionIndex)
+        {
+            storeQueueCount--;
+        }
+
+        branchStats.squashedInstructions += instructionsStatus.size() - (instructionIndex + 1);
+        instructionsStatus.truncate(instructionIndex + 1);
+
+        if (!renamesPhysically())
+        {
+            for (Register &reg : registers)
+                reg.robTag = -1;
+            for (int i = robHead;; i = (i + 1) % robSize)
+            {
+                if (writesRegister(rob[i].type))
+                    registers[rob[i].destination].robTag = i;
+                if (i == robTag)
+                    break;
+            }
+        }
+
+        rebuildWakeups();
+    }
+
+    void rebuildWakeups()
+    {
+        wakeupHead.assign(robSize, -1);
+        stations.forEachBusy([this](int id)
+                             {
+            if (stations.qj[id] != -1)
+                addWakeup(stations.qj[id], 2 * id);
+            if (stations.qk[id] != -1)
+                addWakeup(stations.qk[id], 2 * id + 1); });
+    }
+
+    LoadCheck checkOlderStores(int load, int &value) const
+    {
+        bool bypassed = false;
+        for (int i = storeQueueCount - 1; i >= 0; i--)
+        {
+            const ROBEntry &store = rob[storeQueue[(storeQueueHead + i) % robSize]];
+            if (store.instructionIndex > stations.instructionIndex[load])
+                continue;
+
+            if (!store.hasAddress)
+                return LoadCheck::WaitAddress;
+
+            if (store.destination != stations.addr[load])
+            {
+                bypassed = true;
+                continue;
+            }
+
+            if (!config.storeForwarding || !store.storeDataReady)
+                return LoadCheck::WaitData;
+
+            value = store.storeData;
+            return LoadCheck::Forward;
+        }
+
+        return bypassed ? LoadCheck::Bypass : LoadCheck::Clear;
+    }
+
+    bool startLoad(int rs)
+    {
+        int value = 0;
+        switch (checkOlderStores(rs, value))
+        {
+        case LoadCheck::WaitAddress:
+            lsqStats.addressWaitCycles++;
+            return false;
+        case LoadCheck::WaitData:
+            lsqStats.dataWaitCycles++;
+            return false;
+        case LoadCheck::Forward:
+            lsqStats.forwardedLoads++;
+            stations.forwarded[rs] = true;
+            stations.forwardedValue[rs] = value;
+            return true;
+        case LoadCheck::Bypass:
+            lsqStats.bypassingLoads++;
+            return true;
+        case LoadCheck::Clear:
+            break;
+        }
+        return true;
+    }
+
+    void executeInstructions()
+    {
+        TOMASULO_STAT(for (int unit = 0; unit < UNIT_COUNT; unit++) stats.operandWaitCycles[unit] += stations.waitingCount(static_cast<Unit>(unit)));
+
+        stations.forEachExecuting([this](int rs)
+                                  {
+            if (usesPool(stations.op[rs]))
+                return;
+
+            if (stations.unitOfStation(rs) == Unit::LoadStore)
+            {
+                if (stations.op[rs] == Opcode::SW && !stations.hasAddress[rs] && rob[stations.destRobTag[rs]].hasAddress)
+                {
+                    stations.addr[rs] = rob[stations.destRobTag[rs]].destination;
+                    stations.hasAddress[rs] = true;
+                }
+
+                if (!stations.started[rs])
+                {
+                    if (stations.op[rs] == Opcode::LW && !startLoad(rs))
+                        return;
+
+                    stations.started[rs] = true;
+                    if (cache.enabled() && !stations.forwarded[rs])
+                        stations.remainingCycles[rs] = cache.access(stations.addr[rs], cycle);
+                }
+            }
+
+            if (--stations.remainingCycles[rs] == 0)
+            {
+                stations.markDone(rs);
+                instructionsStatus[stations.instructionIndex[rs]].execCompleteTime = cycle + 1;
+            } });
+
+        if (!pooling)
+            return;
+
+        dispatchToPools();
+        for (FunctionalUnitPool &pool : pools)
+        {
+            for (UnitOperation &operation : pool.operations)
+            {
+                if (operation.remainingCycles > 0 && --operation.remainingCycles == 0)
+                    instructionsStatus[operation.instructionIndex].execCompleteTime = cycle + 1;
+            }
+        }
+    }
+
+    bool usesPool(Opcode op) const
+    {
+        if (!pooling)
+            return false;
+        Pool pool = poolOf(op);
+        return pool != Pool::None && pools[static_cast<int>(pool)].enabled();
+    }
+
+    // Ready stations compete for the units oldest first; a dispatched
+    // operation starts counting down in the same cycle, so a pool with enough
+    // units matches the timing of executing in the station.
+    void dispatchToPools()
+    {
+        dispatchCandidates.clear();
+        stations.forEachExecuting([this](int rs)
+                                  {
+            if (usesPool(stations.op[rs]))
+                dispatchCandidates.push_back({stations.instructionIndex[rs], rs}); });
+        if (dispatchCandidates.empty())
+            return;
+
+        sort(dispatchCandidates.begin(), dispatchCandidates.end());
+        for (const auto &candidate : dispatchCandidates)
+        {
+            int rs = candidate.second;
+            FunctionalUnitPool &pool = pools[static_cast<int>(poolOf(stations.op[rs]))];
+            int unit = pool.freeUnit(cycle);
+            if (unit == -1)
+            {
+                pool.stats.waitCycles++;
+                continue;
+            }
+
+            pool.dispatch(unit, cycle, {stations.op[rs], stations.vj[rs], stations.vk[rs], stations.destRobTag[rs],
+                                        stations.instructionIndex[rs], stations.remainingCycles[rs]});
+            stations.reset(rs);
+        }
+    }
+
+    static bool usesCdb(Opcode op)
+    {
+        return op != Opcode::SW && op != Opcode::BEQ && op != Opcode::BNE;
+    }
+
+    long long arbitrateCdb()
+    {
+        if (config.cdbCount <= 0)
+            return LLONG_MAX;
+
+        cdbCandidates.clear();
+        stations.forEachDone([this](int rs)
+                             {
+            if (usesCdb(stations.op[rs]))
+                cdbCandidates.push_back(stations.instructionIndex[rs]); });
+        for (const FunctionalUnitPool &pool : pools)
+        {
+            for (const UnitOperation &operation : pool.operations)
+            {
+                if (operation.remainingCycles == 0 && usesCdb(operation.op))
+                    cdbCandidates.push_back(operation.instructionIndex);
+            }
+        }
+
+        if (static_cast<int>(cdbCandidates.size()) <= config.cdbCount)
+            return LLONG_MAX;
+
+        cdbConflictStalls += cdbCandidates.size() - config.cdbCount;
+        nth_element(cdbCandidates.begin(), cdbCandidates.begin() + (config.cdbCount - 1), cdbCandidates.end());
+        return cdbCandidates[config.cdbCount - 1];
+    }
+
+    void writeResults()
+    {
+        long long youngestGranted = arbitrateCdb();
+
+        stations.forEachDone([this, youngestGranted](int rs)
+                             {
+            if (!usesCdb(stations.op[rs]) || stations.instructionIndex[rs] <= youngestGranted)
+                writeResult(rs); });
+
+        if (pooling)
+            writePoolResults(youngestGranted);
+    }
+
+    void writePoolResults(long long youngestGranted)
+    {
+        for (FunctionalUnitPool &pool : pools)
+        {
+            for (size_t i = 0; i < pool.operations.size();)
+            {
+                UnitOperation operation = pool.operations[i];
+                if (operation.remainingCycles > 0 || (usesCdb(operation.op) && operation.instructionIndex > youngestGranted))
+                {
+                    i++;
+                    continue;
+                }
+
+                pool.operations.erase(pool.operations.begin() + i);
+                writeResult(operation);
+                // A mispredicted branch squashes operations anywhere in the
+                // pool, so rescan from the start.
+                i = 0;
+            }
+        }
+    }
+
+    void writeResult(int rs)
+    {
+        Opcode op = stations.op[rs];
+        if (op != Opcode::LW && op != Opcode::SW)
+        {
+            UnitOperation operation = {op, stations.vj[rs], stations.vk[rs], stations.destRobTag[rs], stations.instructionIndex[rs], 0};
+            stations.reset(rs);
+            writeResult(operation);
+            return;
+        }
+
+        int robTag = stations.destRobTag[rs];
+        instructionsStatus[stations.instructionIndex[rs]].writeResultTime = cycle + 1;
+
+        if (op == Opcode::SW)
+        {
+            rob[robTag].value = stations.vk[rs];
+            rob[robTag].ready = true;
+            stations.reset(rs);
+            return;
+        }
+
+        int result = stations.forwarded[rs] ? stations.forwardedValue[rs] : memory.read(stations.addr[rs]);
+        stations.reset(rs);
+        publishResult(robTag, result);
+    }
+
+    void writeResult(const UnitOperation &operation)
+    {
+        int robTag = operation.destRobTag;
+        instructionsStatus[operation.instructionIndex].writeResultTime = cycle + 1;
+
+        if (isBranch(operation.op))
+        {
+            bool taken = (operation.vj == operation.vk) == (operation.op == Opcode::BEQ);
+            rob[robTag].value = taken ? 1 : 0;
+            rob[robTag].ready = true;
+            resolveBranch(robTag, taken);
+            return;
+        }
+
+        int result = 0;
+        switch (operation.op)
+        {
+        case Opcode::ADD:
+        case Opcode::SUB:
+        case Opcode::MUL:
+            result = arithmeticResult(operation.op, operation.vj, operation.vk);
+            break;
+        case Opcode::DIV:
+            if (operation.vk != 0)
+            {
+                result = arithmeticResult(operation.op, operation.vj, operation.vk);
+            }
+            else if (outputLevel != OutputLevel::Silent)
+            {
+                cerr << "Warning: Division by zero detected!" << endl;
+            }
+            break;
+        default:
+            break;
+        }
+
+        publishResult(robTag, result);
+    }
+
+    void publishResult(int robTag, int result)
+    {
+        rob[robTag].value = result;
+        rob[robTag].ready = true;
+        if (renamesPhysically())
+            physical.write(rob[robTag].physical, result);
+        broadcastResult(robTag, result);
+    }
+
+    void commit()
+    {
+        TOMASULO_STAT(recordOccupancy(1));
+
+        int slot = 0;
+        while (slot < config.commitWidth && commitOne())
+            slot++;
+
+        TOMASULO_STAT(stats.commitSlots += slot);
+        TOMASULO_STAT(stats.stallSlots[static_cast<int>(headStall())] += config.commitWidth - slot);
+    }
+
+#ifndef TOMASULO_NO_STATS
+    CommitStall headStall() const
+    {
+        const ROBEntry &head = rob[robHead];
+        if (!head.busy)
+            return CommitStall::Frontend;
+
+        switch (head.type)
+        {
+        case InstrType::Load:
+            return CommitStall::Load;
+        case InstrType::Store:
+            return CommitStall::Store;
+        case InstrType::Branch:
+            return CommitStall::Branch;
+        case InstrType::Arith:
+            break;
+        }
+        Opcode op = instructionsStatus[head.instructionIndex].instruction.op;
+        return unitOf(op) == Unit::MulDiv ? CommitStall::MulDiv : CommitStall::AddSub;
+    }
+
+    void recordOccupancy(long long weight)
+    {
+        int robCount = rob[robHead].busy ? (robTail - robHead + robSize - 1) % robSize + 1 : 0;
+        stats.robOccupancy[robCount] += weight;
+
+        for (int unit = 0; unit < UNIT_COUNT; unit++)
+            stats.stationOccupancy[unit][stations.busyCount(static_cast<Unit>(unit))] += weight;
+        if (renamesPhysically())
+            stats.physicalOccupancy[physical.inUse()] += weight;
+    }
+
+    void printHistogram(const char *title, const char *detail, const vector<long long> &histogram) const
+    {
+        long long samples = 0;
+        double sum = 0.0;
+        for (size_t i = 0; i < histogram.size(); i++)
+        {
+            samples += histogram[i];
+            sum += static_cast<double>(i) * histogram[i];
+        }
+
+        *output << title << detail << " (average " << (samples > 0 ? sum / samples : 0.0) << "):";
+        for (size_t i = 0; i < histogram.size(); i++)
+        {
+            if (histogram[i] > 0)
+                *output << " " << i << "=" << histogram[i];
+        }
+        *output << endl;
+    }
+
+    void printMicroStatistics() const
+    {
+        *output << "\nMicroarchitectural Statistics:" << endl;
+        *output << "Issue stalls: ROB full " << robFullStalls;
+        for (int unit = 0; unit < UNIT_COUNT; unit++)
+            *output << ", no " << unitName(static_cast<Unit>(unit)) << " station " << stats.noStationStalls[unit];
+        if (renamesPhysically())
+            *output << ", no free physical register " << physicalRegisterStalls;
+        *output << endl;
+
+        *output << "Operand wait cycles:";
+        for (int unit = 0; unit < UNIT_COUNT; unit++)
+            *output << (unit > 0 ? ", " : " ") << unitName(static_cast<Unit>(unit)) << " " << stats.operandWaitCycles[unit];
+        *output << endl;
+
+        printHistogram("ROB occupancy", "", stats.robOccupancy);
+        for (int unit = 0; unit < UNIT_COUNT; unit++)
+            printHistogram(unitName(static_cast<Unit>(unit)), " station occupancy", stats.stationOccupancy[unit]);
+        if (renamesPhysically())
+            printHistogram("Physical registers in use", "", stats.physicalOccupancy);
+
+        if (stats.commitSlots == 0)
+            return;
+
+        double instructions = static_cast<double>(stats.commitSlots);
+        double width = config.commitWidth;
+        double total = stats.commitSlots / width / instructions;
+        *output << "CPI stack (" << stats.commitSlots << " committed instructions):" << endl;
+        *output << "  base\t\t\t" << stats.commitSlots / width / instructions << endl;
+        for (int cause = 0; cause < COMMIT_STALL_COUNT; cause++)
+        {
+            double component = stats.stallSlots[cause] / width / instructions;
+            total += component;
+            if (stats.stallSlots[cause] > 0)
+                *output << "  " << commitStallName(static_cast<CommitStall>(cause)) << (cause == 0 ? "\t" : "\t\t\t") << component << endl;
+        }
+        *output << "  total\t\t\t" << total << endl;
+    }
+#endif
+
+    bool commitOne()
+    {
+        if (!rob[robHead].busy)
+            return false;
+
+        ROBEntry &entry = rob[robHead];
+        if (entry.ready)
+        {
+            if (writesRegister(entry.type))
+            {
+                registers[entry.destination].value = entry.value;
+                if (renamesPhysically())
+                    physical.retire(entry.previousPhysical);
+                else if (registers[entry.destination].robTag == robHead)
+                    registers[entry.destination].robTag = -1;
+            }
+            else if (entry.type == InstrType::Store)
+            {
+                memory.write(entry.destination, entry.value);
+                if (storeLog != nullptr)
+                    storeLog->emplace_back(entry.destination, entry.value);
+                storeQueueHead = (storeQueueHead + 1) % robSize;
+                storeQueueCount--;
+            }
+            else if (entry.type == InstrType::Branch)
+            {
+                retireBranch(robHead);
+            }
+
+            instructionsStatus[entry.instructionIndex].commitTime = cycle + 1;
+            instructionsStatus.retire();
+            committedInstructions++;
+
+            rob[robHead].busy = false;
+            robHead = (robHead + 1) % robSize;
+            return true;
+        }
+        return false;
+    }
+
+    // Sites live in a sorted vector reserved for BRANCH_SITE_CAPACITY
+    // branches, so the first commit of a branch does not allocate.
+    BranchSiteStats &branchSite(int pc)
+    {
+        auto it = lower_bound(branchSites.begin(), branchSites.end(), pc, [](const pair<int, BranchSiteStats> &entry, int key)
+                              { return entry.first < key; });
+        if (it == branchSites.end() || it->first != pc)
+            it = branchSites.insert(it, {pc, BranchSiteStats()});
+        return it->second;
+    }
+
+    void retireBranch(int robTag)
+    {
+        const PendingBranch &branch = pendingBranches[robTag];
+        if (!branch.conditional)
+        {
+            branchStats.jumps++;
+            return;
+        }
+
+        predictor.update(branch.pc, branch.history, branch.taken);
+
+        bool mispredicted = branch.taken != branch.predictedTaken;
+        BranchSiteStats &site = branchSite(branch.pc);
+        site.instruction = instructionsStatus[rob[robTag].instructionIndex].instruction;
+        site.executions++;
+        branchStats.branches++;
+
+        if (mispredicted)
+        {
+            site.mispredictions++;
+            site.cyclesLost += branch.cyclesLost;
+            branchStats.mispredictions++;
+            branchStats.cyclesLost += branch.cyclesLost;
+        }
+    }
+
+    void addWakeup(int robTag, int node)
+    {
+        wakeupNext[node] = wakeupHead[robTag];
+        wakeupHead[robTag] = node;
+    }
+
+    void broadcastResult(int robTag, int value)
+    {
+        int node = wakeupHead[robTag];
+        wakeupHead[robTag] = -1;
+
+        while (node != -1)
+        {
+            int rs = node >> 1;
+            int next = wakeupNext[node];
+
+            if ((node & 1) == 0)
+            {
+                stations.vj[rs] = value;
+                stations.qj[rs] = -1;
+
+                if (stations.op[rs] == Opcode::LW)
+                {
+                    stations.addr[rs] = wrappingAdd(value, stations.imm[rs]);
+                    stations.hasAddress[rs] = true;
+                }
+                else if (stations.op[rs] == Opcode::SW)
+                {
+                    rob[stations.destRobTag[rs]].destination = wrappingAdd(value, stations.imm[rs]);
+                    rob[stations.destRobTag[rs]].hasAddress = true;
+                }
+            }
+            else
+            {
+                stations.vk[rs] = value;
+                stations.qk[rs] = -1;
+
+                if (stations.op[rs] == Opcode::SW)
+                {
+                    rob[stations.destRobTag[rs]].storeData = value;
+                    rob[stations.destRobTag[rs]].storeDataReady = true;
+                }
+            }
+
+            stations.updateReady(rs);
+            node = next;
+        }
+    }
+
+    bool isBlockedLoad(int rs) const
+    {
+        if (stations.op[rs] != Opcode::LW || stations.started[rs])
+            return false;
+
+        int value = 0;
+        LoadCheck check = checkOlderStores(rs, value);
+        return check == LoadCheck::WaitAddress || check == LoadCheck::WaitData;
+    }
+
+    bool canIssue(const Instruction &next) const
+    {
+        if (rob[robTail].busy)
+            return false;
+        if (next.op == Opcode::J)
+            return true;
+        if (stations.firstFree(unitOf(next.op)) == -1)
+            return false;
+        return !renamesPhysically() || !writesRegister(typeOf(next.op)) || physical.hasFree();
+    }
+
+    long long idleCycles()
+    {
+        if (rob[robHead].busy && rob[robHead].ready)
+            return 0;
+
+        const Instruction *next = instructions.peek();
+        if (!draining && next != nullptr && canIssue(*next))
+            return 0;
+
+        int nextCompletion = INT_MAX;
+        long long nextDispatch = LLONG_MAX;
+        bool eventNow = false;
+        stations.forEachBusy([this, &nextCompletion, &nextDispatch, &eventNow](int rs)
+                             {
+            if (stations.done(rs))
+            {
+                eventNow = true;
+                return;
+            }
+
+            if (!stations.operandsReady(rs))
+                return;
+
+            if (usesPool(stations.op[rs]))
+            {
+                const FunctionalUnitPool &pool = pools[static_cast<int>(poolOf(stations.op[rs]))];
+                nextDispatch = min(nextDispatch, pool.nextFree());
+                if (nextDispatch <= cycle)
+                    eventNow = true;
+                return;
+            }
+
+            if (!stations.started[rs] && (stations.op[rs] == Opcode::LW || stations.op[rs] == Opcode::SW))
+            {
+                if (isBlockedLoad(rs))
+                    return;
+                if (cache.enabled() || stations.op[rs] == Opcode::LW)
+                {
+                    eventNow = true;
+                    return;
+                }
+            }
+
+            nextCompletion = min(nextCompletion, stations.remainingCycles[rs]); });
+
+        for (const FunctionalUnitPool &pool : pools)
+        {
+            for (const UnitOperation &operation : pool.operations)
+            {
+                if (operation.remainingCycles == 0)
+                    eventNow = true;
+                nextCompletion = min(nextCompletion, operation.remainingCycles);
+            }
+        }
+
+        if (eventNow || (nextCompletion == INT_MAX && nextDispatch == LLONG_MAX))
+            return 0;
+        return min<long long>(nextCompletion - 1, nextDispatch - cycle);
+    }
+
+    void skipIdleCycles()
+    {
+        long long skip = min(idleCycles(), cycleLimit - cycle - 1);
+        if (skip == 0)
+            return;
+
+        TOMASULO_STAT(recordOccupancy(skip));
+        TOMASULO_STAT(stats.stallSlots[static_cast<int>(headStall())] += skip * config.commitWidth);
+
+        TOMASULO_STAT(for (int unit = 0; unit < UNIT_COUNT; unit++) stats.operandWaitCycles[unit] += skip * stations.waitingCount(static_cast<Unit>(unit)));
+
+        stations.forEachExecuting([this, skip](int rs)
+                                  {
+            if (usesPool(stations.op[rs]))
+            {
+                pools[static_cast<int>(poolOf(stations.op[rs]))].stats.waitCycles += skip;
+                return;
+            }
+
+            if (isBlockedLoad(rs))
+            {
+                int value = 0;
+                if (checkOlderStores(rs, value) == LoadCheck::WaitAddress)
+                    lsqStats.addressWaitCycles += skip;
+                else
+                    lsqStats.dataWaitCycles += skip;
+                return;
+            }
+
+            if (stations.op[rs] == Opcode::SW && !stations.hasAddress[rs] && rob[stations.destRobTag[rs]].hasAddress)
+            {
+                stations.addr[rs] = rob[stations.destRobTag[rs]].destination;
+                stations.hasAddress[rs] = true;
+            }
+
+            stations.remainingCycles[rs] -= static_cast<int>(skip); });
+
+        for (FunctionalUnitPool &pool : pools)
+        {
+            for (UnitOperation &operation : pool.operations)
+                operation.remainingCycles -= static_cast<int>(skip);
+        }
+
+        if (!draining && !instructions.empty())
+        {
+            Unit unit = unitOf(instructions.peek()->op);
+            if (rob[robTail].busy)
+            {
+                robFullStalls += skip;
+            }
+            else if (stations.firstFree(unit) == -1)
+            {
+                stationFullStalls += skip;
+                TOMASULO_STAT(stats.noStationStalls[static_cast<int>(unit)] += skip);
+            }
+            else
+            {
+                physicalRegisterStalls += skip;
+            }
+        }
+
+        if (outputLevel == OutputLevel::Full)
+            *output << "\n=== Cycles " << cycle + 1 << "-" << cycle + skip << " skipped ===\n";
+        cycle += skip;
+    }
+
+    bool checkSimulationComplete()
+    {
+        if (!instructions.empty())
+            return false;
+
+        if (stations.anyBusy())
+            return false;
+
+        for (const auto &entry : rob)
+        {
+            if (entry.busy)
+                return false;
+        }
+
+        return true;
+    }
+
+    string formatDestination(const ROBEntry &entry) const
+    {
+        if (entry.type == InstrType::Branch)
+            return to_string(entry.destination);
+        if (entry.type != InstrType::Store)
+            return registerName(entry.destination);
+        return entry.hasAddress ? to_string(entry.destination) : "";
+    }
+
+    bool shouldPrintCycle() const
+    {
+        if (outputLevel == OutputLevel::Full)
+            return true;
+        return outputLevel == OutputLevel::Sampled && (cycle + 1) % sampleInterval == 0;
+    }
+
+    void printStations(const char *title, Unit unit)
+    {
+        bool loadStore = unit == Unit::LoadStore;
+        *output << "\nReservation Station " << title << ":\n";
+        *output << (loadStore ? "Name\tBusy\tOp\tA\tVj\tVk\tQj\tQk\tDestROB\n" : "Name\tBusy\tOp\tVj\tVk\tQj\tQk\tDestROB\n");
+        for (int rs = stations.begin(unit); rs < stations.end(unit); rs++)
+        {
+            bool busy = stations.busy(rs);
+            *output << stations.name(rs) << "\t"
+                 << (busy ? "Yes" : "No") << "\t"
+                 << (busy ? opcodeName(stations.op[rs]) : "-") << "\t";
+            if (loadStore)
+                *output << (stations.hasAddress[rs] ? to_string(stations.addr[rs]) : "-") << "\t";
+            *output << stations.vj[rs] << "\t"
+                 << stations.vk[rs] << "\t"
+                 << (stations.qj[rs] != -1 ? "ROB" + to_string(stations.qj[rs]) : "-") << "\t"
+                 << (stations.qk[rs] != -1 ? "ROB" + to_string(stations.qk[rs]) : "-") << "\t"
+                 << (stations.destRobTag[rs] != -1 ? "ROB" + to_string(stations.destRobTag[rs]) : "-") << "\n";
+        }
+    }
+
+    void printState()
+    {
+        printStations("ADD/SUB", Unit::AddSub);
+        printStations("MUL/DIV", Unit::MulDiv);
+        printStations("LOAD/STORE", Unit::LoadStore);
+
+        for (int pool = 0; pool < POOL_COUNT; pool++)
+        {
+            if (!pools[pool].enabled())
+                continue;
+
+            *output << "\nFunctional Units " << poolName(pool) << ":\n";
+            *output << "Op\tVj\tVk\tDestROB\tRemaining\n";
+            for (const UnitOperation &operation : pools[pool].operations)
+            {
+                *output << opcodeName(operation.op) << "\t"
+                     << operation.vj << "\t"
+                     << operation.vk << "\t"
+                     << "ROB" << operation.destRobTag << "\t"
+                     << operation.remainingCycles << "\n";
+            }
+        }
+
+        *output << "\nROB Status:\n";
+        *output << "Entry\tBusy\tReady\tType\tDest\tValue\n";
+        for (int i = 0; i < robSize; i++)
+        {
+            auto &entry = rob[i];
+            *output << i << "\t"
+                 << (entry.busy ? "Yes" : "No") << "\t"
+                 << (entry.ready ? "Yes" : "No") << "\t"
+                 << (entry.busy ? instrTypeName(entry.type) : "-") << "\t"
+                 << (entry.busy ? formatDestination(entry) : "-") << "\t"
+                 << (entry.busy ? to_string(entry.value) : "-") << "\n";
+        }
+
+        *output << "\nRegisters Status:\n";
+        *output << (renamesPhysically() ? "Reg\tValue\tPhys\tROB Tag\n" : "Reg\tValue\tROB Tag\n");
+
+        for (int i = 0; i < NUM_REGISTERS; i++)
+        {
+            if (!usedRegisters[i])
+                continue;
+
+            const auto &reg = registers[i];
+            int robTag = reg.robTag;
+            *output << registerName(i) << "\t"
+                 << reg.value << "\t";
+            if (renamesPhysically())
+            {
+                int mapped = physical.lookup(i);
+                robTag = physical.producer(mapped);
+                *output << "P" << mapped << "\t";
+            }
+            *output << (robTag != -1 ? "ROB" + to_string(robTag) : "-") << "\n";
+        }
+    }
+
+    void printBranchStatistics()
+    {
+        *output << "\nBranch Statistics:" << endl;
+        *output << "Predictor: " << predictor.name() << endl;
+        *output << "Conditional branches: " << branchStats.branches << ", jumps: " << branchStats.jumps << endl;
+        *output << "Mispredictions: " << branchStats.mispredictions;
+        if (branchStats.branches > 0)
+            *output << " (" << 100.0 * branchStats.mispredictions / branchStats.branches << "%)";
+        *output << endl;
+        *output << "Cycles lost to mispredictions: " << branchStats.cyclesLost;
+        if (branchStats.mispredictions > 0)
+            *output << " (" << static_cast<double>(branchStats.cyclesLost) / branchStats.mispredictions << " per misprediction)";
+        *output << endl;
+        *output << "Squashed instructions: " << branchStats.squashedInstructions << endl;
+
+        if (branchSites.empty())
+            return;
+
+        *output << "PC\tBranch\t\t\tExecuted\tMispredicted\tCyclesLost" << endl;
+        for (const auto &entry : branchSites)
+        {
+            const BranchSiteStats &site = entry.second;
+            *output << entry.first << "\t" << formatInstruction(site.instruction) << "\t\t"
+                 << site.executions << "\t\t" << site.mispredictions << "\t\t" << site.cyclesLost << endl;
+        }
+    }
+
+    void printUnitStatistics()
+    {
+        *output << "\nFunctional Unit Statistics:" << endl;
+        *output << "Unit\tCount\tLatency\tCycles/Op\tDispatched\tUtilization\tWaitCycles" << endl;
+        for (int pool = 0; pool < POOL_COUNT; pool++)
+        {
+            const FunctionalUnitPool &units = pools[pool];
+            if (!units.enabled())
+                continue;
+
+            double capacity = static_cast<double>(units.count()) * cycle;
+            *output << poolName(pool) << "\t" << units.count() << "\t" << units.operationLatency() << "\t"
+                 << units.cyclesPerOperation() << "\t\t" << units.stats.dispatched << "\t\t"
+                 << (capacity > 0 ? 100.0 * units.stats.busyCycles / capacity : 0.0) << "%\t\t"
+                 << units.stats.waitCycles << endl;
+        }
+    }
+
+    void printTimelineRow(const InstructionStatus &status)
+    {
+        *output << formatInstruction(status.instruction)
+             << "\t\t" << status.issueTime << "\t"
+             << status.execCompleteTime << "\t\t"
+             << status.writeResultTime << "\t\t"
+             << status.commitTime << endl;
+    }
+
+    void printFinalResults()
+    {
+        *output << "\n=== Final Results ===" << endl;
+
+        const TimelineWriter &streamed = instructionsStatus.streamed();
+        if (!streamed.path().empty())
+        {
+            *output << "\nInstruction Timeline: " << streamed.count() << " committed instructions written to "
+                    << streamed.path() << endl;
+        }
+
+        else if (!instructionsStatus.complete())
+        {
+            *output << "\nInstruction Timeline: " << instructionsStatus.firstInFlight()
+                    << " committed instructions (listed only with full or sampled output)" << endl;
+        }
+
+        if (instructionsStatus.complete() || instructionsStatus.firstInFlight() < instructionsStatus.size())
+        {
+            *output << (instructionsStatus.complete() ? "\nInstruction Timeline:" : "\nIn flight:") << endl;
+            *output << "Instruction\t\tIssue\tExecComp\tWriteRes\tCommit" << endl;
+            instructionsStatus.forEach([this](const InstructionStatus &status)
+                                       { printTimelineRow(status); });
+        }
+
+        if (fastForwardedInstructions > 0)
+            *output << "\nFast-forwarded instructions: " << fastForwardedInstructions << endl;
+
+        *output << "\nFinal Register Values:" << endl;
+        for (int i = 0; i < NUM_REGISTERS; i++)
+        {
+            if (usedRegisters[i])
+                *output << registerName(i) << " = " << registers[i].value << endl;
+        }
+
+        *output << "\nFinal Memory Contents:" << endl;
+        memory.forEachNonZero([this](int address, int value)
+                              { *output << "Memory[" << address << "] = " << value << endl; });
+
+        if (lsqStats.forwardedLoads + lsqStats.bypassingLoads + lsqStats.addressWaitCycles + lsqStats.dataWaitCycles > 0)
+        {
+            *output << "\nLoad/Store Queue Statistics:" << endl;
+            *output << "Forwarded loads: " << lsqStats.forwardedLoads << endl;
+            *output << "Loads bypassing older stores: " << lsqStats.bypassingLoads << endl;
+            *output << "Load cycles waiting on store address: " << lsqStats.addressWaitCycles << endl;
+            *output << "Load cycles waiting on store data: " << lsqStats.dataWaitCycles << endl;
+        }
+
+        if (any_of(pools.begin(), pools.end(), [](const FunctionalUnitPool &pool)
+                   { return pool.enabled(); }))
+            printUnitStatistics();
+
+        if (branchStats.branches + branchStats.jumps > 0)
+            printBranchStatistics();
+
+        if (cache.enabled())
+        {
+            *output << "\nCache Statistics:" << endl;
+            cache.printStatistics(*output);
+        }
+
+        TOMASULO_STAT(printMicroStatistics());
+    }
+};
+
+TomasuloConfig makeConfig(int addQuantity, int mulQuantity, int loadStoreQuantity, int robSize)
+{
+    TomasuloConfig config;
+    config.addStations = addQuantity;
+    config.mulStations = mulQuantity;
+    config.loadStoreStations = loadStoreQuantity;
+    config.robSize = robSize;
+    return config;
+}
+
+Tomasulo::Tomasulo(int addQuantity, int mulQuantity, int loadStoreQuantity, int robSize)
+    : Tomasulo(makeConfig(addQuantity, mulQuantity, loadStoreQuantity, robSize)) {}
+
+Tomasulo::Tomasulo(const TomasuloConfig &config) : core(new Core(config)) {}
+
+Tomasulo::Tomasulo(Tomasulo &&other) noexcept = default;
+
+Tomasulo &Tomasulo::operator=(Tomasulo &&other) noexcept = default;
+
+Tomasulo::~Tomasulo() = default;
+
+bool Tomasulo::loadInstructions(const string &filePath)
+{
+    return core->loadInstructions(filePath);
+}
+
+bool Tomasulo::generateInstructions(const GeneratorConfig &generator, const string &outputPath)
+{
+    return core->generateInstructions(generator, outputPath);
+}
+
+void Tomasulo::useInstructions(const vector<Instruction> &trace)
+{
+    core->useInstructions(trace);
+}
+
+void Tomasulo::setInitialState(const InitialState &state)
+{
+    core->setInitialState(state);
+}
+
+void Tomasulo::setRegister(const string &name, int value)
+{
+    core->setRegister(name, value);
+}
+
+void Tomasulo::setMemory(int address, int value)
+{
+    core->setMemory(address, value);
+}
+
+void Tomasulo::setOutputLevel(OutputLevel level, int interval)
+{
+    core->setOutputLevel(level, interval);
+}
+
+void Tomasulo::setTimelineRetained(bool retained)
+{
+    core->setTimelineRetained(retained);
+}
+
+void Tomasulo::setOutputStream(ostream &stream)
+{
+    core->setOutputStream(stream);
+}
+
+bool Tomasulo::setStateTrace(const string &filePath)
+{
+    return core->setStateTrace(filePath);
+}
+
+bool Tomasulo::setTimelineFile(const string &filePath)
+{
+    return core->setTimelineFile(filePath);
+}
+
+void Tomasulo::setEventDriven(bool enabled)
+{
+    core->setEventDriven(enabled);
+}
+
+void Tomasulo::run()
+{
+    core->run();
+}
+
+bool Tomasulo::step()
+{
+    return core->step();
+}
+
+bool Tomasulo::runUntil(long long cycle)
+{
+    return core->runUntil(cycle);
+}
+
+void Tomasulo::recordStores(vector<pair<int, int>> *log)
+{
+    core->recordStores(log);
+}
+
+void Tomasulo::finish()
+{
+    core->finish();
+}
+
+bool Tomasulo::completed() const
+{
+    return core->completed();
+}
+
+long long Tomasulo::committed() const
+{
+    return core->committed();
+}
+
+void Tomasulo::drain()
+{
+    core->drain();
+}
+
+long long Tomasulo::fastForward(long long count, long long warmup)
+{
+    return core->fastForward(count, warmup);
+}
+
+vector<char> Tomasulo::checkpoint() const
+{
+    return core->checkpoint();
+}
+
+bool Tomasulo::restore(const vector<char> &bytes)
+{
+    return core->restore(bytes);
+}
+
+bool Tomasulo::saveCheckpoint(const string &filePath) const
+{
+    return core->saveCheckpoint(filePath);
+}
+
+bool Tomasulo::restoreCheckpoint(const string &filePath)
+{
+    return core->restoreCheckpoint(filePath);
+}
+
+bool Tomasulo::readCheckpoint(const string &filePath, vector<char> &payload)
+{
+    return Core::readCheckpoint(filePath, payload);
+}
+
+RunSummary Tomasulo::summary() const
+{
+    return core->summary();
+}
+
+SimulationResult Tomasulo::result() const
+{
+    return core->result();
+}
+
+bool isValidConfig(const TomasuloConfig &config)
+{
+    return config.addStations > 0 && config.mulStations > 0 && config.loadStoreStations > 0 && config.robSize > 0 &&
+           config.addSubLatency > 0 && config.mulLatency > 0 && config.divLatency > 0 && config.loadStoreLatency > 0 &&
+           config.issueWidth > 0 && config.commitWidth > 0 && config.cdbCount >= 0 &&
+           (config.physicalRegisters == 0 || config.physicalRegisters > NUM_REGISTERS) &&
+           config.adders.count >= 0 && config.adders.interval > 0 &&
+           config.multipliers.count >= 0 && config.multipliers.interval > 0 &&
+           config.dividers.count >= 0 && config.dividers.interval > 0 &&
+           config.predictor.tableBits > 0 && config.predictor.tableBits <= 24 &&
+           config.predictor.historyBits > 0 && config.predictor.historyBits <= 24;
+}
+
+bool loadDecodedTrace(const string &filePath, vector<Instruction> &trace)
+{
+    TraceStream stream(4096);
+    if (!stream.open(filePath))
+        return false;
+
+    trace.clear();
+    while (const Instruction *next = stream.peek())
+    {
+        trace.push_back(*next);
+        stream.pop();
+    }
+    return true;
+}
+
+// Calls visit(entry, status) for the timeline entries numbered first to
+// last, seeking past the blocks outside that range.
+template <typename Visitor>
+static bool scanTimeline(const string &filePath, long long first, long long last, Visitor visit)
+{
+    TimelineReader reader;
+    if (!reader.open(filePath))
+        return false;
+
+    vector<InstructionStatus> entries;
+    TimelineBlockHeader block;
+    while (reader.next(block))
+    {
+        if (block.count == 0 || block.firstEntry > last)
+            return true;
+
+        if (block.firstEntry + block.count <= first)
+        {
+            if (!reader.skip(block))
+                return false;
+            continue;
+        }
+
+        if (!reader.decode(block, entries))
+            return false;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            long long entry = block.firstEntry + static_cast<long long>(i);
+            if (entry >= first && entry <= last)
+                visit(entry, entries[i]);
+        }
+    }
+    return false;
+}
+
+bool readTimeline(const string &filePath, long long first, long long last, vector<InstructionStatus> &entries)
+{
+    entries.clear();
+    return scanTimeline(filePath, first, last, [&entries](long long, const InstructionStatus &status)
+                        { entries.push_back(status); });
+}
+
+bool findTimelineCycles(const string &filePath, long long fromCycle, long long toCycle, long long &first, long long &last)
+{
+    TimelineReader reader;
+    if (!reader.open(filePath))
+        return false;
+
+    first = 0;
+    last = -1;
+    bool found = false;
+    vector<InstructionStatus> entries;
+    TimelineBlockHeader block;
+    while (reader.next(block))
+    {
+        if (block.count == 0 || block.firstCommit > toCycle)
+            return true;
+
+        if (block.lastCommit < fromCycle)
+        {
+            if (!reader.skip(block))
+                return false;
+            continue;
+        }
+
+        if (!reader.decode(block, entries))
+            return false;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (entries[i].commitTime < fromCycle || entries[i].commitTime > toCycle)
+                continue;
+
+            long long entry = block.firstEntry + static_cast<long long>(i);
+            if (!found)
+                first = entry;
+            last = entry;
+            found = true;
+        }
+    }
+    return false;
+}
+
+bool summarizeTimeline(const string &filePath, long long first, long long last, TimelineSummary &summary)
+{
+    summary = TimelineSummary();
+    return scanTimeline(filePath, first, last, [&summary](long long, const InstructionStatus &status)
+                        {
+                            int op = static_cast<int>(status.instruction.op);
+                            if (summary.instructions++ == 0)
+                                summary.firstIssue = status.issueTime;
+                            summary.lastCommit = status.commitTime;
+                            summary.count[op]++;
+                            summary.executeCycles[op] += status.execCompleteTime - status.issueTime;
+                            summary.resultCycles[op] += status.writeResultTime - status.execCompleteTime;
+                            summary.commitCycles[op] += status.commitTime - status.writeResultTime;
+                        });
+}
+
+InitialState defaultInitialState()
+{
+    InitialState state;
+    state.registers = {{0, 5}, {1, 3}, {2, 2}, {3, 3}, {4, 2}, {5, 5}};
+    state.memory = {{105, 10}, {203, 0}};
+    return state;
+}
+
+bool loadInitialState(const string &filePath, InitialState &state)
+{
+    ifstream input(filePath);
+    if (!input)
+    {
+        cerr << "Error opening file: " << filePath << endl;
+        return false;
+    }
+
+    string line;
+    int lineNumber = 0;
+    while (getline(input, line))
+    {
+        lineNumber++;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == string::npos || line[first] == '#')
+            continue;
+
+        char name[32];
+        int address, value;
+        if (sscanf(line.c_str() + first, "Memory[%d] = %d", &address, &value) == 2)
+        {
+            state.memory.emplace_back(address, value);
+            continue;
+        }
+
+        int reg;
+        if (sscanf(line.c_str() + first, "%31[^ =] = %d", name, &value) == 2 && (reg = parseRegister(name)) != -1)
+        {
+            state.registers.emplace_back(reg, value);
+            continue;
+        }
+
+        cerr << "Invalid initial state at " << filePath << ":" << lineNumber << ": " << line << endl;
+        return false;
+    }
+    return true;
+}
+
+SimulationResult simulate(const TomasuloConfig &config, const vector<Instruction> &program, const InitialState &state)
+{
+    Tomasulo simulator(config);
+    simulator.setOutputLevel(OutputLevel::Silent);
+    simulator.setTimelineRetained(true);
+    simulator.setEventDriven(true);
+    simulator.useInstructions(program);
+    simulator.setInitialState(state);
+    simulator.run();
+    return simulator.result();
+}
+
+vector<Instruction> generateTrace(const GeneratorConfig &config)
+{
+    vector<Instruction> trace;
+    trace.reserve(config.length);
+
+    TraceGenerator generator(config);
+    Instruction instruction;
+    while (generator.next(instruction))
+        trace.push_back(instruction);
+    return trace;
+}
+
+class QuantumBarrier
+{
+private:
+    mutex lock;
+    condition_variable released;
+    int parties;
+    int waiting;
+    long long generation;
+
+public:
+    explicit QuantumBarrier(int parties)
+        : parties(parties), waiting(0), generation(0) {}
+
+    // The last thread to arrive runs complete() while the others are still
+    // blocked, so it may read every core's state without further locking.
+    template <typename Completion>
+    void arrive(Completion complete)
+    {
+        unique_lock<mutex> guard(lock);
+        long long current = generation;
+        if (++waiting == parties)
+        {
+            complete();
+            waiting = 0;
+            generation++;
+            released.notify_all();
+            return;
+        }
+        released.wait(guard, [this, current]
+                      { return generation != current; });
+    }
+};
+
+MulticoreResult simulateMulticore(const MulticoreConfig &config, const vector<vector<Instruction>> &traces,
+                                  const InitialState &state)
+{
+    MulticoreResult result;
+    int coreCount = config.cores;
+    if (coreCount <= 0 || config.quantum <= 0 || (traces.size() != 1 && traces.size() != static_cast<size_t>(coreCount)))
+    {
+        cerr << "Invalid multi-core configuration: " << coreCount << " cores, " << traces.size() << " traces" << endl;
+        return result;
+    }
+    int threadCount = min(coreCount, config.threads > 0 ? config.threads : coreCount);
+
+    vector<Tomasulo> cores;
+    cores.reserve(coreCount);
+    for (int i = 0; i < coreCount; i++)
+    {
+        cores.emplace_back(config.core);
+        cores[i].setOutputLevel(OutputLevel::Silent);
+        cores[i].setEventDriven(true);
+        cores[i].useInstructions(traces.size() == 1 ? traces[0] : traces[i]);
+        cores[i].setInitialState(state);
+    }
+
+    // Stores committed during quantum q go to storeLogs[core][q % 2]. After the
+    // barrier every thread replays all logs, in core order, into the memory of
+    // its own cores while the other buffer collects the next quantum's stores.
+    vector<array<vector<pair<int, int>>, 2>> storeLogs(coreCount);
+    QuantumBarrier barrier(threadCount);
+    long long quanta = 0;
+    bool finished = false;
+
+    auto work = [&](int self)
+    {
+        int first = coreCount * self / threadCount;
+        int last = coreCount * (self + 1) / threadCount;
+
+        for (long long quantum = 0;; quantum++)
+        {
+            int buffer = quantum % 2;
+            long long end = (quantum + 1) * config.quantum;
+            for (int i = first; i < last; i++)
+            {
+                storeLogs[i][buffer].clear();
+                cores[i].recordStores(&storeLogs[i][buffer]);
+                cores[i].runUntil(end);
+            }
+
+            barrier.arrive([&]
+                           {
+                quanta = quantum + 1;
+                finished = all_of(cores.begin(), cores.end(), [](const Tomasulo &core)
+                                  { return core.completed(); }); });
+
+            for (int i = first; i < last; i++)
+            {
+                for (int writer = 0; writer < coreCount; writer++)
+                {
+                    for (const auto &store : storeLogs[writer][buffer])
+                        cores[i].setMemory(store.first, store.second);
+                }
+            }
+
+            if (finished)
+                return;
+        }
+    };
+
+    vector<thread> threads;
+    for (int i = 1; i < threadCount; i++)
+        threads.emplace_back(work, i);
+    work(0);
+    for (thread &t : threads)
+        t.join();
+
+    result.quanta = quanta;
+    for (Tomasulo &core : cores)
+    {
+        core.recordStores(nullptr);
+        result.cores.push_back(core.summary());
+    }
+    result.memory = cores[0].result().memory;
+    return result;
+}
+
+#ifdef TOMASULO_COUNT_ALLOCATIONS
+static thread_local long long allocations = 0;
+
+long long threadAllocations()
+{
+    return allocations;
+}
+
+// Kept out of line: once inlined, GCC matches malloc() and free() against the
+// operator new/delete call sites and reports mismatched deallocations.
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    allocations++;
+    if (void *memory = malloc(size > 0 ? size : 1))
+        return memory;
+    throw bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+#endif
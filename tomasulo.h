@@ -0,0 +1,358 @@
+#ifndef TOMASULO_H
+#define TOMASULO_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class Opcode : uint8_t
+{
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    LW,
+    SW,
+    BEQ,
+    BNE,
+    J
+};
+
+const int OPCODE_COUNT = 9;
+
+struct Instruction
+{
+    Opcode op;
+    int8_t rd;
+    int8_t rs1;
+    int8_t rs2;
+    int32_t imm;
+};
+
+const int NUM_REGISTERS = 32;
+
+struct InstructionStatus
+{
+    Instruction instruction;
+    long long issueTime, execCompleteTime, writeResultTime, commitTime;
+
+    InstructionStatus()
+        : InstructionStatus(Instruction{}) {}
+
+    InstructionStatus(const Instruction &instruction)
+        : instruction(instruction), issueTime(-1), execCompleteTime(-1), writeResultTime(-1), commitTime(-1) {}
+};
+
+enum class OutputLevel
+{
+    Silent,
+    FinalOnly,
+    Sampled,
+    Full
+};
+
+enum class ReplacementPolicy
+{
+    LRU,
+    FIFO,
+    Random
+};
+
+struct CacheLevelConfig
+{
+    int sizeBytes;
+    int associativity;
+    int lineBytes;
+    int hitLatency;
+    ReplacementPolicy policy;
+};
+
+struct CacheConfig
+{
+    bool enabled = false;
+    CacheLevelConfig l1 = {32 * 1024, 8, 64, 2, ReplacementPolicy::LRU};
+    CacheLevelConfig l2 = {256 * 1024, 8, 64, 10, ReplacementPolicy::LRU};
+    int memoryLatency = 100;
+    int mshrCount = 8;
+};
+
+enum class PredictorKind
+{
+    Static,
+    Bimodal,
+    Gshare
+};
+
+struct PredictorConfig
+{
+    PredictorKind kind = PredictorKind::Static;
+    int tableBits = 10;
+    int historyBits = 8;
+};
+
+enum class RenameMode
+{
+    ReorderBuffer,
+    PhysicalRegisters
+};
+
+// A pool of functional units shared by one class of operations. Stations hand
+// ready operations to the pool oldest first and are freed on dispatch; a unit
+// accepts a new operation every `interval` cycles, or once the previous one
+// finishes when it is not pipelined. With count = 0 the operations execute in
+// their reservation station, as if every station had a private unit.
+struct FunctionalUnitConfig
+{
+    int count = 0;
+    int interval = 1;
+    bool pipelined = true;
+};
+
+const int ADD_SUB_LATENCY = 2;
+const int MUL_LATENCY = 10;
+const int DIV_LATENCY = 40;
+const int LOAD_STORE_LATENCY = 2;
+
+struct TomasuloConfig
+{
+    int addStations = 3;
+    int mulStations = 2;
+    int loadStoreStations = 3;
+    int robSize = 6;
+    int addSubLatency = ADD_SUB_LATENCY;
+    int mulLatency = MUL_LATENCY;
+    int divLatency = DIV_LATENCY;
+    int loadStoreLatency = LOAD_STORE_LATENCY;
+    int issueWidth = 1;
+    int commitWidth = 1;
+    int cdbCount = 0;
+    bool storeForwarding = true;
+    RenameMode renaming = RenameMode::ReorderBuffer;
+    int physicalRegisters = 0; // 0 = NUM_REGISTERS + robSize
+    FunctionalUnitConfig adders;      // ADD, SUB, BEQ, BNE
+    FunctionalUnitConfig multipliers; // MUL
+    FunctionalUnitConfig dividers;    // DIV
+    CacheConfig cache;
+    PredictorConfig predictor;
+};
+
+enum class AddressPattern
+{
+    Stride,
+    Random,
+    HotSet
+};
+
+struct GeneratorConfig
+{
+    uint64_t seed = 1;
+    uint64_t length = 0;
+    int mix[6] = {4, 2, 2, 1, 3, 1};
+    std::vector<std::pair<int, int>> distances = {{0, 2}, {1, 3}, {2, 2}, {4, 2}, {8, 1}, {16, 1}};
+    AddressPattern pattern = AddressPattern::Stride;
+    int stride = 1;
+    int footprint = 4096;
+    int hotSetSize = 64;
+    int hotPercent = 90;
+};
+
+struct RunSummary
+{
+    long long cycles;
+    long long instructions;
+    long long robFullStalls;
+    long long stationFullStalls;
+    long long cdbConflictStalls;
+    long long physicalRegisterStalls;
+
+    double ipc() const
+    {
+        return cycles > 0 ? static_cast<double>(instructions) / cycles : 0.0;
+    }
+};
+
+struct MulticoreConfig
+{
+    TomasuloConfig core;
+    int cores = 8;
+    int quantum = 1000;
+    int threads = 0; // 0 = one host thread per core
+};
+
+struct MulticoreResult
+{
+    std::vector<RunSummary> cores;
+    long long quanta = 0;
+    std::map<int, int> memory;
+
+    long long cycles() const
+    {
+        long long longest = 0;
+        for (const RunSummary &core : cores)
+            longest = core.cycles > longest ? core.cycles : longest;
+        return longest;
+    }
+
+    long long instructions() const
+    {
+        long long total = 0;
+        for (const RunSummary &core : cores)
+            total += core.instructions;
+        return total;
+    }
+
+    double ipc() const
+    {
+        return cycles() > 0 ? static_cast<double>(instructions()) / cycles() : 0.0;
+    }
+};
+
+struct BranchStats
+{
+    long long branches = 0;
+    long long jumps = 0;
+    long long mispredictions = 0;
+    long long cyclesLost = 0;
+    long long squashedInstructions = 0;
+};
+
+struct LsqStats
+{
+    long long forwardedLoads = 0;
+    long long bypassingLoads = 0;
+    long long addressWaitCycles = 0;
+    long long dataWaitCycles = 0;
+};
+
+struct FunctionalUnitStats
+{
+    long long dispatched = 0;
+    long long busyCycles = 0; // unit-cycles in which a unit could not accept an operation
+    long long waitCycles = 0; // station-cycles with ready operands but no free unit
+};
+
+// Totals over a range of a timeline file. Latencies are summed per opcode,
+// so averages can be taken for any subset of opcodes.
+struct TimelineSummary
+{
+    long long instructions = 0;
+    long long firstIssue = -1;
+    long long lastCommit = -1;
+    long long count[OPCODE_COUNT] = {};
+    long long executeCycles[OPCODE_COUNT] = {}; // issue to execution complete
+    long long resultCycles[OPCODE_COUNT] = {};  // execution complete to write result
+    long long commitCycles[OPCODE_COUNT] = {};  // write result to commit
+};
+
+struct InitialState
+{
+    std::vector<std::pair<int, int>> registers;
+    std::vector<std::pair<int, int>> memory;
+};
+
+struct SimulationResult
+{
+    RunSummary summary;
+    long long fastForwardedInstructions;
+    std::vector<InstructionStatus> timeline;
+    std::vector<int> registers;
+    std::map<int, int> memory;
+    BranchStats branches;
+    LsqStats lsq;
+    FunctionalUnitStats adders;
+    FunctionalUnitStats multipliers;
+    FunctionalUnitStats dividers;
+};
+
+class Tomasulo
+{
+public:
+    Tomasulo(int addQuantity, int mulQuantity, int loadStoreQuantity, int robSize = 6);
+    explicit Tomasulo(const TomasuloConfig &config = TomasuloConfig());
+    Tomasulo(Tomasulo &&other) noexcept;
+    Tomasulo &operator=(Tomasulo &&other) noexcept;
+    ~Tomasulo();
+
+    bool loadInstructions(const std::string &filePath);
+    bool generateInstructions(const GeneratorConfig &generator, const std::string &outputPath = "");
+    void useInstructions(const std::vector<Instruction> &trace);
+
+    void setInitialState(const InitialState &state);
+    void setRegister(const std::string &name, int value);
+    void setMemory(int address, int value);
+
+    void setOutputLevel(OutputLevel level, int interval = 1);
+    // Keeps the committed timeline for result() at any output level; by
+    // default it is kept only for full and sampled output.
+    void setTimelineRetained(bool retained);
+    void setOutputStream(std::ostream &stream);
+    bool setStateTrace(const std::string &filePath);
+    bool setTimelineFile(const std::string &filePath);
+    void setEventDriven(bool enabled);
+    void recordStores(std::vector<std::pair<int, int>> *log);
+
+    void run();
+    bool step();
+    bool runUntil(long long cycle);
+    void finish();
+    bool completed() const;
+    long long committed() const;
+
+    void drain();
+    long long fastForward(long long count, long long warmup = 0);
+
+    std::vector<char> checkpoint() const;
+    bool restore(const std::vector<char> &bytes);
+    bool saveCheckpoint(const std::string &filePath) const;
+    bool restoreCheckpoint(const std::string &filePath);
+    static bool readCheckpoint(const std::string &filePath, std::vector<char> &payload);
+
+    RunSummary summary() const;
+    SimulationResult result() const;
+
+private:
+    class Core;
+    std::unique_ptr<Core> core;
+};
+
+bool isValidConfig(const TomasuloConfig &config);
+const char *opcodeName(Opcode op);
+std::string formatInstruction(const Instruction &instruction);
+bool decodeProgram(const std::string &source, std::vector<Instruction> &program);
+bool loadDecodedTrace(const std::string &filePath, std::vector<Instruction> &trace);
+bool convertTextTrace(const std::string &inputPath, const std::string &outputPath);
+
+InitialState defaultInitialState();
+bool loadInitialState(const std::string &filePath, InitialState &state);
+
+SimulationResult simulate(const TomasuloConfig &config, const std::vector<Instruction> &program,
+                          const InitialState &state = defaultInitialState());
+
+std::vector<Instruction> generateTrace(const GeneratorConfig &config);
+
+// Timeline files (setTimelineFile, --timeline-out) hold the committed
+// instructions in commit order, numbered from 0. Commit cycles never
+// decrease, so a range of cycles is also a contiguous range of entries.
+bool readTimeline(const std::string &filePath, long long first, long long last, std::vector<InstructionStatus> &entries);
+bool findTimelineCycles(const std::string &filePath, long long fromCycle, long long toCycle, long long &first, long long &last);
+bool summarizeTimeline(const std::string &filePath, long long first, long long last, TimelineSummary &summary);
+
+// Runs config.cores copies of the core, each on its own trace (or all on
+// traces[0]), spread over config.threads host threads. Cores advance in
+// lockstep quanta of config.quantum cycles; a store becomes visible to the
+// other cores at the next quantum boundary, where all stores of the quantum
+// are applied in core order, so results do not depend on thread timing.
+MulticoreResult simulateMulticore(const MulticoreConfig &config, const std::vector<std::vector<Instruction>> &traces,
+                                  const InitialState &state = defaultInitialState());
+
+#ifdef TOMASULO_COUNT_ALLOCATIONS
+// Heap allocations made so far by the calling thread. Builds with
+// -DTOMASULO_COUNT_ALLOCATIONS replace the global operator new to count them.
+long long threadAllocations();
+#endif
+
+#endif